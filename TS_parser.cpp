@@ -1,14 +1,266 @@
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TS_PARSER_X86 1
+#endif
 
 using namespace std;
 
 class xTS {
     public:
         static constexpr uint32_t TS_PacketLength = 188;
+        static constexpr uint32_t M2TS_PacketLength = 192;  //4B TP_extra_header + TS packet
+        static constexpr uint32_t FEC_PacketLength = 204;   //TS packet + 16B Reed-Solomon parity
+        static constexpr uint8_t TS_SyncByte = 0x47;
         static constexpr uint32_t TS_HeaderLength = 4;
         static constexpr uint32_t PES_HeaderLength = 6;
         static constexpr uint32_t BaseToExtendedClockMultiplier =      300;
+        static constexpr uint32_t InputBlockLength = TS_PacketLength * 4096; //~770kB, whole packets
+        static constexpr uint32_t InputBlockAlignment = 4096;
+};
+
+//per stage tick counters (rdtsc) and per PID tallies in thread local blocks, summed on export as Prometheus text or JSON;
+//without TS_PARSER_INSTRUMENT the probes are empty and compile away
+class xTS_Instrument {
+    public:
+#ifdef TS_PARSER_INSTRUMENT
+        static constexpr bool Enabled = true;
+#else
+        static constexpr bool Enabled = false;
+#endif
+        //Output (PES written) is nested in Assembly
+        enum class eStage : uint32_t { Read, Sync, Table, Header, Adaptation, Monitor, Assembly, Output, Log, NumStages };
+        static constexpr uint32_t NumStages = (uint32_t) eStage::NumStages;
+        static constexpr uint32_t NumPIDs = 8192;
+
+    protected:
+        //one writer per block, relaxed atomics are plain loads and stores on x86 and keep the exporter race free
+        struct xThreadBlock {
+            atomic<uint64_t> StageTicks[NumStages];
+            atomic<uint64_t> StageCalls[NumStages];
+            atomic<uint64_t> Packets[NumPIDs];
+            atomic<uint64_t> Bytes[NumPIDs];
+            atomic<uint64_t> PES[NumPIDs];
+        };
+
+        inline static thread_local xThreadBlock *t_Block = nullptr;
+        inline static mutex s_Mutex;
+        inline static vector<unique_ptr<xThreadBlock>> s_Blocks;   //owns the blocks, they outlive their threads and are freed at exit
+        //exporter
+        inline static thread s_Exporter;
+        inline static condition_variable s_Wakeup;
+        inline static bool s_Stop = false;
+        inline static string s_Path;
+        inline static uint32_t s_Interval = 0;      //ms
+
+    public:
+        static uint64_t Now() {
+#ifdef TS_PARSER_X86
+            return __rdtsc();
+#else
+            return xMonotonic();
+#endif
+        }
+
+        //start tick of a stage, 0 when disabled
+        static uint64_t Begin() {
+            if constexpr (Enabled) return Now();
+            return 0;
+        }
+
+        //charges the ticks since BeginTicks to Stage and returns the current tick, so consecutive stages need one read each
+        static uint64_t Lap(eStage Stage, uint64_t BeginTicks) {
+            if constexpr (Enabled) {
+                uint64_t Ticks = Now();
+                xThreadBlock *Block = xBlock();
+                xAdd(Block->StageTicks[(uint32_t) Stage], Ticks - BeginTicks);
+                xAdd(Block->StageCalls[(uint32_t) Stage], 1);
+                return Ticks;
+            }
+            return 0;
+        }
+        static void End(eStage Stage, uint64_t BeginTicks) { Lap(Stage, BeginTicks); }
+
+        static void CountPacket(uint16_t PID, uint32_t NumBytes) {
+            if constexpr (Enabled) {
+                xThreadBlock *Block = xBlock();
+                xAdd(Block->Packets[PID], 1);
+                xAdd(Block->Bytes[PID], NumBytes);
+            }
+        }
+
+        static void CountPES(uint16_t PID) {
+            if constexpr (Enabled) xAdd(xBlock()->PES[PID], 1);
+        }
+
+        //times the enclosing scope
+        class xScope {
+            protected:
+                eStage m_Stage;
+                uint64_t m_Begin;
+
+            public:
+                explicit xScope(eStage Stage) : m_Stage(Stage), m_Begin(Begin()) {}
+                ~xScope() { End(m_Stage, m_Begin); }
+        };
+
+        //exports to Path every Interval ms (Prometheus text format, JSON if Path ends in .json), replaced atomically
+        //through Path.tmp so collectors never see a partial file
+        static int32_t Start(const char *Path, uint32_t Interval) {
+            if constexpr (!Enabled) return -1;
+            s_Path = Path;
+            s_Interval = Interval;
+            if (xExport() != 0) return -1;
+            if (Interval != 0) s_Exporter = thread(xExporter);
+            return 0;
+        }
+
+        //stops the exporter and writes the final state
+        static void Stop() {
+            if constexpr (!Enabled) return;
+            if (s_Path.empty()) return;
+            if (s_Exporter.joinable()) {
+                {
+                    lock_guard<mutex> Lock(s_Mutex);
+                    s_Stop = true;
+                }
+                s_Wakeup.notify_one();
+                s_Exporter.join();
+            }
+            if (xExport() != 0) printf("cannot write instrumentation to %s\n", s_Path.c_str());
+        }
+
+        static const char *getStageName(uint32_t Stage) {
+            static const char *const Names[NumStages] = {"read", "sync", "table", "header", "adaptation", "monitor", "assembly", "output", "log"};
+            return Names[Stage];
+        }
+
+    protected:
+        static uint64_t xMonotonic() {
+            timespec Time;
+            clock_gettime(CLOCK_MONOTONIC, &Time);
+            return (uint64_t) Time.tv_sec * 1000000000ull + Time.tv_nsec;
+        }
+
+        static void xAdd(atomic<uint64_t> &Counter, uint64_t Value) {
+            Counter.store(Counter.load(memory_order_relaxed) + Value, memory_order_relaxed);
+        }
+
+        static xThreadBlock *xBlock() {
+            if (t_Block == nullptr) {
+                unique_ptr<xThreadBlock> Block(new xThreadBlock());
+                t_Block = Block.get();
+                lock_guard<mutex> Lock(s_Mutex);
+                s_Blocks.push_back(move(Block));
+            }
+            return t_Block;
+        }
+
+        static void xExporter() {
+            unique_lock<mutex> Lock(s_Mutex);
+            while (!s_Stop) {
+                s_Wakeup.wait_for(Lock, chrono::milliseconds(s_Interval));
+                if (s_Stop) break;
+                Lock.unlock();
+                xExport();
+                Lock.lock();
+            }
+        }
+
+        static int32_t xExport() {
+            uint64_t StageTicks[NumStages] = {}, StageCalls[NumStages] = {};
+            vector<uint64_t> Packets(NumPIDs, 0), Bytes(NumPIDs, 0), PES(NumPIDs, 0);
+            {
+                lock_guard<mutex> Lock(s_Mutex);
+                for (const unique_ptr<xThreadBlock> &Block : s_Blocks) {
+                    for (uint32_t Stage = 0; Stage < NumStages; Stage++) {
+                        StageTicks[Stage] += Block->StageTicks[Stage].load(memory_order_relaxed);
+                        StageCalls[Stage] += Block->StageCalls[Stage].load(memory_order_relaxed);
+                    }
+                    for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                        Packets[PID] += Block->Packets[PID].load(memory_order_relaxed);
+                        Bytes[PID] += Block->Bytes[PID].load(memory_order_relaxed);
+                        PES[PID] += Block->PES[PID].load(memory_order_relaxed);
+                    }
+                }
+            }
+            //tick rate measured over the run, 1 when ticks are nanoseconds already
+            double Elapsed = (xMonotonic() - s_StartTime) * 1e-9;
+            double TicksPerSecond = Elapsed > 0 ? (Now() - s_StartTicks) / Elapsed : 1e9;
+
+            string TemporaryPath = s_Path + ".tmp";
+            FILE *File = fopen(TemporaryPath.c_str(), "w");
+            if (File == nullptr) return -1;
+            bool JSON = s_Path.size() >= 5 and s_Path.compare(s_Path.size() - 5, 5, ".json") == 0;
+            if (JSON) {
+                fprintf(File, "{\"elapsed_s\":%.6f,\"ticks_per_s\":%.0f,\"stages\":{", Elapsed, TicksPerSecond);
+                for (uint32_t Stage = 0; Stage < NumStages; Stage++) {
+                    fprintf(File, "%s\"%s\":{\"calls\":%lu,\"ticks\":%lu,\"seconds\":%.6f}", Stage != 0 ? "," : "", getStageName(Stage),
+                            StageCalls[Stage], StageTicks[Stage], StageTicks[Stage] / TicksPerSecond);
+                }
+                fprintf(File, "},\"pids\":{");
+                bool First = true;
+                for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                    if (Packets[PID] == 0) continue;
+                    fprintf(File, "%s\"%d\":{\"packets\":%lu,\"bytes\":%lu,\"pes\":%lu}", First ? "" : ",", PID, Packets[PID], Bytes[PID], PES[PID]);
+                    First = false;
+                }
+                fprintf(File, "}}\n");
+            } else {
+                fprintf(File, "# HELP ts_parser_stage_seconds_total Time spent per parser stage.\n# TYPE ts_parser_stage_seconds_total counter\n");
+                for (uint32_t Stage = 0; Stage < NumStages; Stage++) {
+                    fprintf(File, "ts_parser_stage_seconds_total{stage=\"%s\"} %.9f\n", getStageName(Stage), StageTicks[Stage] / TicksPerSecond);
+                }
+                fprintf(File, "# HELP ts_parser_stage_calls_total Timed calls per parser stage.\n# TYPE ts_parser_stage_calls_total counter\n");
+                for (uint32_t Stage = 0; Stage < NumStages; Stage++) {
+                    fprintf(File, "ts_parser_stage_calls_total{stage=\"%s\"} %lu\n", getStageName(Stage), StageCalls[Stage]);
+                }
+                const char *const Names[3] = {"packets", "bytes", "pes"};
+                const vector<uint64_t> *Values[3] = {&Packets, &Bytes, &PES};
+                for (uint32_t Metric = 0; Metric < 3; Metric++) {
+                    fprintf(File, "# HELP ts_parser_pid_%s_total Transport stream %s per PID.\n# TYPE ts_parser_pid_%s_total counter\n",
+                            Names[Metric], Names[Metric], Names[Metric]);
+                    for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                        if (Packets[PID] != 0) fprintf(File, "ts_parser_pid_%s_total{pid=\"%d\"} %lu\n", Names[Metric], PID, (*Values[Metric])[PID]);
+                    }
+                }
+            }
+            if (fclose(File) != 0) return -1;
+            return rename(TemporaryPath.c_str(), s_Path.c_str()) == 0 ? 0 : -1;
+        }
+
+        //after the functions they call
+        inline static const uint64_t s_StartTicks = Now();
+        inline static const uint64_t s_StartTime = xMonotonic();
 };
 
 class xTS_PacketHeader {
@@ -41,7 +293,7 @@ class xTS_PacketHeader {
             payloadUnitStartIndicator = (Input[1] & 0b01000000) != 0;
             transportPriority = (Input[1] & 0b00100000) != 0;
             packetIdentifier = ((((uint16_t)(Input[1]) << 8)) | (uint16_t)(Input[2])) & 8191; //binary 0b0001111111111111
-            transportScramblingControl = Input[3] & 0b11000000;
+            transportScramblingControl = (Input[3] & 0b11000000) >> 6;
             adaptationFieldControl = (Input[3] & 0b00110000) >> 4;
             continuityCounter = Input[3] & 0b00001111;
 
@@ -60,12 +312,294 @@ class xTS_PacketHeader {
         bool isPayloadUnitStartIndicator() const { return payloadUnitStartIndicator; }
         uint16_t getPacketIdentifier() const { return packetIdentifier; }
         uint8_t getAdaptationFieldControl() const { return adaptationFieldControl; }
+        bool isTransportErrorIndicator() const { return transportErrorIndicator; }
+        bool isTransportPriority() const { return transportPriority; }
+        uint8_t getTransportScramblingControl() const { return transportScramblingControl; }
+        uint8_t getContinuityCounter() const { return continuityCounter; }
 
     public:
         bool hasAdaptationField() const { return adaptationFieldControl == 2 or adaptationFieldControl == 3; }
         bool hasPayload() const { return adaptationFieldControl == 1 or adaptationFieldControl == 3; }
 };
 
+//columnar (struct-of-arrays) view of the headers of a block of packets
+class xTS_PacketTable {
+    public:
+        static constexpr uint32_t MaxNumPackets = xTS::InputBlockLength / xTS::TS_PacketLength;
+
+        typedef void (*xDecoder)(xTS_PacketTable *Table, const uint8_t *Input, uint32_t First, uint32_t NumPackets, uint32_t Stride);
+
+    protected:
+        uint32_t m_NumPackets = 0;
+        alignas(32) uint16_t m_PacketIdentifier[MaxNumPackets];
+        alignas(32) uint8_t m_SyncByte[MaxNumPackets];
+        alignas(32) uint8_t m_TransportErrorIndicator[MaxNumPackets];
+        alignas(32) uint8_t m_PayloadUnitStartIndicator[MaxNumPackets];
+        alignas(32) uint8_t m_TransportScramblingControl[MaxNumPackets];
+        alignas(32) uint8_t m_AdaptationFieldControl[MaxNumPackets];
+        alignas(32) uint8_t m_ContinuityCounter[MaxNumPackets];
+
+        static xDecoder s_Decoder;
+        static const char *s_DecoderName;
+
+    public:
+        //decodes up to MaxNumPackets headers placed every Stride bytes
+        int32_t Parse(const uint8_t *Input, uint32_t NumPackets, uint32_t Stride = xTS::TS_PacketLength) {
+            if (NumPackets > MaxNumPackets) return -1;
+            m_NumPackets = NumPackets;
+            s_Decoder(this, Input, 0, NumPackets, Stride);
+            return NumPackets;
+        }
+
+        uint32_t getNumPackets() const { return m_NumPackets; }
+        uint8_t getSyncByte(uint32_t Idx) const { return m_SyncByte[Idx]; }
+        bool isTransportErrorIndicator(uint32_t Idx) const { return m_TransportErrorIndicator[Idx]; }
+        bool isPayloadUnitStartIndicator(uint32_t Idx) const { return m_PayloadUnitStartIndicator[Idx]; }
+        uint16_t getPacketIdentifier(uint32_t Idx) const { return m_PacketIdentifier[Idx]; }
+        uint8_t getTransportScramblingControl(uint32_t Idx) const { return m_TransportScramblingControl[Idx]; }
+        uint8_t getAdaptationFieldControl(uint32_t Idx) const { return m_AdaptationFieldControl[Idx]; }
+        uint8_t getContinuityCounter(uint32_t Idx) const { return m_ContinuityCounter[Idx]; }
+
+        const uint16_t *getPacketIdentifiers() const { return m_PacketIdentifier; }
+
+        static const char *getDecoderName() { return s_DecoderName; }
+
+    protected:
+        //header word loaded little endian: b0 | b1 << 8 | b2 << 16 | b3 << 24
+        static uint32_t xLoadHeader(const uint8_t *Input) {
+            uint32_t Word;
+            memcpy(&Word, Input, sizeof(Word));
+            return Word;
+        }
+
+        static void xDecodeScalar(xTS_PacketTable *Table, const uint8_t *Input, uint32_t First, uint32_t NumPackets, uint32_t Stride) {
+            for (uint32_t i = First; i < NumPackets; i++) {
+                uint32_t Word = xLoadHeader(Input + (size_t) i * Stride);
+                Table->m_SyncByte[i] = Word & 0xFF;
+                Table->m_TransportErrorIndicator[i] = (Word >> 15) & 1;
+                Table->m_PayloadUnitStartIndicator[i] = (Word >> 14) & 1;
+                Table->m_PacketIdentifier[i] = (Word & 0x1F00) | ((Word >> 16) & 0xFF);
+                Table->m_TransportScramblingControl[i] = (Word >> 30) & 3;
+                Table->m_AdaptationFieldControl[i] = (Word >> 28) & 3;
+                Table->m_ContinuityCounter[i] = (Word >> 24) & 0xF;
+            }
+        }
+
+#ifdef TS_PARSER_X86
+        static void xDecodeSSE2(xTS_PacketTable *Table, const uint8_t *Input, uint32_t First, uint32_t NumPackets, uint32_t Stride) {
+            const __m128i Mask1 = _mm_set1_epi32(1);
+            const __m128i Mask3 = _mm_set1_epi32(3);
+            const __m128i Mask15 = _mm_set1_epi32(15);
+            const __m128i Mask255 = _mm_set1_epi32(255);
+            const __m128i MaskPID = _mm_set1_epi32(0x1F00);
+
+            uint32_t i = First;
+            for (; i + 4 <= NumPackets; i += 4) {
+                const uint8_t *Packet = Input + (size_t) i * Stride;
+                __m128i Word = _mm_set_epi32(xLoadHeader(Packet + 3 * Stride), xLoadHeader(Packet + 2 * Stride),
+                                             xLoadHeader(Packet + Stride), xLoadHeader(Packet));
+
+                __m128i PID = _mm_or_si128(_mm_and_si128(Word, MaskPID), _mm_and_si128(_mm_srli_epi32(Word, 16), Mask255));
+                _mm_storel_epi64((__m128i *) (Table->m_PacketIdentifier + i), _mm_packs_epi32(PID, PID));
+
+                xStore4(Table->m_SyncByte + i, _mm_and_si128(Word, Mask255));
+                xStore4(Table->m_TransportErrorIndicator + i, _mm_and_si128(_mm_srli_epi32(Word, 15), Mask1));
+                xStore4(Table->m_PayloadUnitStartIndicator + i, _mm_and_si128(_mm_srli_epi32(Word, 14), Mask1));
+                xStore4(Table->m_TransportScramblingControl + i, _mm_srli_epi32(Word, 30));
+                xStore4(Table->m_AdaptationFieldControl + i, _mm_and_si128(_mm_srli_epi32(Word, 28), Mask3));
+                xStore4(Table->m_ContinuityCounter + i, _mm_and_si128(_mm_srli_epi32(Word, 24), Mask15));
+            }
+            xDecodeScalar(Table, Input, i, NumPackets, Stride);
+        }
+
+        //narrows four 32-bit lanes holding byte values to four bytes
+        static void xStore4(uint8_t *Output, __m128i Value) {
+            __m128i Packed = _mm_packs_epi32(Value, Value);
+            Packed = _mm_packus_epi16(Packed, Packed);
+            uint32_t Word = _mm_cvtsi128_si32(Packed);
+            memcpy(Output, &Word, sizeof(Word));
+        }
+
+        __attribute__((target("avx2")))
+        static void xDecodeAVX2(xTS_PacketTable *Table, const uint8_t *Input, uint32_t First, uint32_t NumPackets, uint32_t Stride) {
+            const __m256i Mask1 = _mm256_set1_epi32(1);
+            const __m256i Mask3 = _mm256_set1_epi32(3);
+            const __m256i Mask15 = _mm256_set1_epi32(15);
+            const __m256i Mask255 = _mm256_set1_epi32(255);
+            const __m256i MaskPID = _mm256_set1_epi32(0x1F00);
+            const __m256i Offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(Stride));
+
+            uint32_t i = First;
+            for (; i + 8 <= NumPackets; i += 8) {
+                const uint8_t *Packet = Input + (size_t) i * Stride;
+                __m256i Word = _mm256_i32gather_epi32((const int *) Packet, Offsets, 1);
+
+                __m256i PID = _mm256_or_si256(_mm256_and_si256(Word, MaskPID), _mm256_and_si256(_mm256_srli_epi32(Word, 16), Mask255));
+                PID = _mm256_permute4x64_epi64(_mm256_packus_epi32(PID, PID), 0b1000);
+                _mm_storeu_si128((__m128i *) (Table->m_PacketIdentifier + i), _mm256_castsi256_si128(PID));
+
+                xStore8(Table->m_SyncByte + i, _mm256_and_si256(Word, Mask255));
+                xStore8(Table->m_TransportErrorIndicator + i, _mm256_and_si256(_mm256_srli_epi32(Word, 15), Mask1));
+                xStore8(Table->m_PayloadUnitStartIndicator + i, _mm256_and_si256(_mm256_srli_epi32(Word, 14), Mask1));
+                xStore8(Table->m_TransportScramblingControl + i, _mm256_srli_epi32(Word, 30));
+                xStore8(Table->m_AdaptationFieldControl + i, _mm256_and_si256(_mm256_srli_epi32(Word, 28), Mask3));
+                xStore8(Table->m_ContinuityCounter + i, _mm256_and_si256(_mm256_srli_epi32(Word, 24), Mask15));
+            }
+            xDecodeScalar(Table, Input, i, NumPackets, Stride);
+        }
+
+        //narrows eight 32-bit lanes holding byte values to eight bytes
+        __attribute__((target("avx2")))
+        static void xStore8(uint8_t *Output, __m256i Value) {
+            const __m256i Shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                     0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            __m256i Packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(Value, Shuffle), _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+            _mm_storel_epi64((__m128i *) Output, _mm256_castsi256_si128(Packed));
+        }
+#endif
+
+        static xDecoder xSelectDecoder(const char **Name) {
+#ifdef TS_PARSER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                *Name = "avx2";
+                return xDecodeAVX2;
+            }
+            if (__builtin_cpu_supports("sse2")) {
+                *Name = "sse2";
+                return xDecodeSSE2;
+            }
+#endif
+            *Name = "scalar";
+            return xDecodeScalar;
+        }
+
+};
+
+const char *xTS_PacketTable::s_DecoderName = "scalar";
+xTS_PacketTable::xDecoder xTS_PacketTable::s_Decoder = xTS_PacketTable::xSelectDecoder(&xTS_PacketTable::s_DecoderName);
+
+//finds the 0x47 lattice in a byte stream and keeps track of the lost bytes
+class xTS_SyncScanner {
+    public:
+        static constexpr uint32_t NumConfirmPackets = 5;
+        static constexpr uint32_t MinConfirmPackets = 2;   //at the end of input
+        static constexpr uint32_t NumPacketSizes = 3;
+        static constexpr uint32_t PacketSizes[NumPacketSizes] = {xTS::TS_PacketLength, xTS::M2TS_PacketLength, xTS::FEC_PacketLength};
+
+    protected:
+        uint32_t m_PacketSize = 0;      //0 - not locked
+        uint64_t m_NumSkippedBytes = 0;
+        uint32_t m_NumSyncLosses = 0;
+        uint32_t m_NumSyncByteErrors = 0;   //corrupted sync bytes seen while locked
+        uint32_t m_NumLocks = 0;
+
+    public:
+        void Reset() {
+            m_PacketSize = 0;
+            m_NumSkippedBytes = 0;
+            m_NumSyncLosses = 0;
+            m_NumSyncByteErrors = 0;
+            m_NumLocks = 0;
+        }
+
+        //returns number of packets (every getPacketSize() bytes) starting at Data with a valid sync byte, each
+        //with its whole stride so that NumPackets * getPacketSize() bytes can be consumed; when 0 is returned
+        //NumSkippedBytes have to be dropped before the next call, none and still locked - retry with getMinBytes()
+        //bytes; Final - no data follows, the last packet needs
+        //only its 188 bytes and a lattice is confirmed with the packets that remain (at least MinConfirmPackets)
+        uint32_t Scan(const uint8_t *Data, size_t Size, size_t &NumSkippedBytes, bool Final = false) {
+            NumSkippedBytes = 0;
+            if (m_PacketSize != 0) {
+                uint32_t NumPackets = 0;
+                size_t PacketLength = Final ? xTS::TS_PacketLength : m_PacketSize;
+                for (size_t Offset = 0; Offset + PacketLength <= Size and Data[Offset] == xTS::TS_SyncByte; Offset += m_PacketSize) {
+                    NumPackets++;
+                }
+                if (NumPackets != 0) return NumPackets;
+                //the packet after a corrupted sync byte decides between an error and a loss, wait for it
+                if (!Final and Size < m_PacketSize + xTS::TS_PacketLength) return 0;
+                m_NumSyncByteErrors++;
+                //a single corrupted sync byte keeps the lock and drops its packet, sync is lost after two (TR 101 290 1.1)
+                if (Size >= m_PacketSize + xTS::TS_PacketLength and Data[m_PacketSize] == xTS::TS_SyncByte) {
+                    NumSkippedBytes = m_PacketSize;
+                    m_NumSkippedBytes += m_PacketSize;
+                    return 0;
+                }
+                m_PacketSize = 0;
+                m_NumSyncLosses++;
+            }
+
+            size_t Offset = 0;
+            while (Offset < Size) {
+                //glibc memchr is vectorized (SSE2/AVX2), no need for a hand written search
+                const uint8_t *Candidate = (const uint8_t *) memchr(Data + Offset, xTS::TS_SyncByte, Size - Offset);
+                if (Candidate == nullptr) {
+                    Offset = Size;
+                    break;
+                }
+                Offset = Candidate - Data;
+                if (!Final and Offset + (NumConfirmPackets - 1) * xTS::FEC_PacketLength + xTS::TS_PacketLength > Size) {
+                    break; //not enough data to confirm, retry with more
+                }
+                if (xConfirm(Data + Offset, Size - Offset)) break;
+                Offset++;
+            }
+
+            NumSkippedBytes = Offset;
+            m_NumSkippedBytes += Offset;
+            return 0;
+        }
+
+        //bytes to request from the input so that a lattice can always be confirmed, or a corrupted sync byte be
+        //told from a loss of sync
+        size_t getMinBytes() const {
+            if (m_PacketSize != 0) return m_PacketSize + xTS::TS_PacketLength;
+            return (NumConfirmPackets - 1) * xTS::FEC_PacketLength + xTS::TS_PacketLength;
+        }
+
+        //bytes to consume after Scan() returned NumPackets for Size bytes, whole strides except for the last packet
+        //of a Final scan that may lack the tail of its stride (M2TS)
+        size_t getNumBytes(uint32_t NumPackets, size_t Size) const {
+            size_t NumBytes = (size_t) NumPackets * m_PacketSize;
+            return NumBytes < Size ? NumBytes : Size;
+        }
+
+        //locks on a lattice confirmed elsewhere (the previous chunk of a file), not counted as a lock
+        void Assume(uint32_t PacketSize) { m_PacketSize = PacketSize; }
+
+        bool isLocked() const { return m_PacketSize != 0; }
+        uint32_t getPacketSize() const { return m_PacketSize; }
+        uint64_t getNumSkippedBytes() const { return m_NumSkippedBytes; }
+        uint32_t getNumSyncLosses() const { return m_NumSyncLosses; }
+        uint32_t getNumSyncByteErrors() const { return m_NumSyncByteErrors; }
+
+        void Print() const {
+            printf("SYNC: PacketSize=%d Locks=%d Losses=%d SkippedBytes=%lu\n",
+                   m_PacketSize, m_NumLocks, m_NumSyncLosses, m_NumSkippedBytes);
+        }
+
+    protected:
+        //fewer than NumConfirmPackets are checked only when Size is short (end of input)
+        bool xConfirm(const uint8_t *Data, size_t Size) {
+            for (uint32_t SizeIdx = 0; SizeIdx < NumPacketSizes; SizeIdx++) {
+                size_t NumAvailable = Size >= xTS::TS_PacketLength ? (Size - xTS::TS_PacketLength) / PacketSizes[SizeIdx] + 1 : 0;
+                uint32_t NumNeeded = NumAvailable < NumConfirmPackets ? NumAvailable : NumConfirmPackets;
+                if (NumNeeded < MinConfirmPackets) continue;
+                uint32_t NumMatching = 1;
+                while (NumMatching < NumNeeded and Data[NumMatching * PacketSizes[SizeIdx]] == xTS::TS_SyncByte) {
+                    NumMatching++;
+                }
+                if (NumMatching == NumNeeded) {
+                    m_PacketSize = PacketSizes[SizeIdx];
+                    m_NumLocks++;
+                    return true;
+                }
+            }
+            return false;
+        }
+};
+
 class xTS_AdaptationField {
     protected:
         uint8_t  adaptationFieldLength;                     //8b
@@ -188,6 +722,13 @@ class xTS_AdaptationField {
         }
 
         uint32_t getNumBytes() const { return adaptationFieldLength; }
+        bool isDiscontinuityIndicator() const { return adaptationFieldLength > 1 and discontinuityIndicator; }
+        bool isRandomAccessIndicator() const { return adaptationFieldLength > 1 and randomAccessIndicator; }
+        bool hasProgramClockReference() const { return adaptationFieldLength > 1 and programClockReferenceFlag; }
+        //27MHz
+        uint64_t getProgramClockReference() const {
+            return programClockReferenceBase * xTS::BaseToExtendedClockMultiplier + programClockReferenceExtension;
+        }
 };
 
 class xPES_PacketHeader {
@@ -273,7 +814,8 @@ class xPES_PacketHeader {
                     PESCRCFlag = (Input[AdaptationFieldOffset + 7] & 0b00000010) != 0;
                     PESExtensionFlag = (Input[AdaptationFieldOffset + 7] & 0b00000001) != 0;
                     PESHeaderDataLength += Input[AdaptationFieldOffset + 8] + 3;
-                    if ((PTSDTSFlags & 0b00000010) != 0 and (Input[AdaptationFieldOffset + 9] & 0b11110000) == 32) {
+                    //PTS prefix is '0010' alone and '0011' when followed by DTS (prefix '0001')
+                    if ((PTSDTSFlags & 0b00000010) != 0 and (Input[AdaptationFieldOffset + 9] >> 4) == PTSDTSFlags) {
                         PTS = (((uint64_t)(Input[AdaptationFieldOffset + 9] & 0b00001110)) << 29 |
                                 ((uint64_t)(Input[AdaptationFieldOffset + 10])) << 21 |
                                 ((uint64_t)(Input[AdaptationFieldOffset + 11] & 0b11111110)) << 14 |
@@ -282,7 +824,7 @@ class xPES_PacketHeader {
 
                     }
 
-                    if ((PTSDTSFlags & 0b00000001) != 0 and (Input[AdaptationFieldOffset + 9] & 0b11110000) == 48) {
+                    if (PTSDTSFlags == 0b11 and (Input[AdaptationFieldOffset + 14] & 0b11110000) == 16) {
                         DTS = (((uint64_t)(Input[AdaptationFieldOffset + 14] & 0b00001110)) << 29 |
                                 ((uint64_t)(Input[AdaptationFieldOffset + 15])) << 21 |
                                 ((uint64_t)(Input[AdaptationFieldOffset + 16] & 0b11111110)) << 14 |
@@ -312,200 +854,4736 @@ class xPES_PacketHeader {
         //PES packet header
         uint16_t getPacketLength() const { return m_PacketLength + xTS::PES_HeaderLength; }
         uint8_t getPesHeaderDataLength() const { return PESHeaderDataLength; }
+        //PES_packet_length == 0, allowed only for video carried in TS
+        bool hasUnboundedLength() const { return m_PacketLength == 0; }
+        uint8_t getStreamId() const { return m_StreamId; }
+        bool hasPTS() const { return (PTSDTSFlags & 0b00000010) != 0; }
+        bool hasDTS() const { return (PTSDTSFlags & 0b00000001) != 0; }
+        uint64_t getPTS() const { return PTS; }
+        uint64_t getDTS() const { return DTS; }
+
+        //lengths only: returns header length up to the payload, PacketLength includes the 6B prefix, 0 if unbounded
+        static uint32_t ParseHeaderLength(const uint8_t *Input, uint32_t Offset, uint32_t &PacketLength) {
+            uint32_t Length = (uint32_t) Input[Offset + 4] << 8 | Input[Offset + 5];
+            PacketLength = Length != 0 ? Length + xTS::PES_HeaderLength : 0;
+            if ((Input[Offset + 6] & 0b11000000) != 128) return xTS::PES_HeaderLength;
+            switch (Input[Offset + 3]) {
+                case eStreamId_program_stream_map: case eStreamId_padding_stream: case eStreamId_private_stream_2:
+                case eStreamId_ECM: case eStreamId_EMM: case eStreamId_program_stream_directory:
+                case eStreamId_DSMCC_stream: case eStreamId_ITUT_H222_1_type_E:
+                    return xTS::PES_HeaderLength;
+                default:
+                    return xTS::PES_HeaderLength + 3 + Input[Offset + 8];
+            }
+        }
 };
 
 
-class xPES_Assembler {
-public:
-    enum class eResult : int32_t {
-        UnexpectedPID = 1,
-        StreamPacketLost,
-        AssemblingStarted,
-        AssemblingContinue,
-        AssemblingFinished,
-    };
+//per PID continuity counter, transport error and scrambling checks with ETSI TR 101 290 style counters
+class xTS_ContinuityMonitor {
+    public:
+        enum class eResult : int32_t {
+            Ok = 0,
+            Duplicate,              //repeated packet, payload must not be used twice
+            Discontinuity,          //signalled by discontinuity_indicator, not an error
+            ContinuityError,        //packets lost
+            TransportError,         //transport_error_indicator set
+        };
 
-protected:
-    //setup
-    int32_t m_PID;
-    FILE *ofs = nullptr;
-    //buffer
-    uint8_t *m_Buffer = nullptr;
-    uint8_t *m_TmpBuffer = nullptr;
-    uint32_t m_BufferSize;
-    uint8_t m_pesOffset;
-    uint32_t m_DataOffset;
-    //operation
-    uint8_t m_LastContinuityCounter;
-    bool m_Started = false;
-    xPES_PacketHeader m_PESH;
+        static constexpr uint32_t NumPIDs = 8192;
+        static constexpr uint16_t NullPID = 0x1FFF;
 
-public:
-    xPES_Assembler() {};
+    protected:
+        struct xState {
+            uint8_t LastContinuityCounter;
+            bool Seen;
+            bool Duplicated;
+        };
 
-    ~xPES_Assembler() {};
+        xState m_State[NumPIDs];
+        uint64_t m_NumPackets[NumPIDs];
+        uint32_t m_NumContinuityErrors[NumPIDs];
+        uint32_t m_NumDuplicates[NumPIDs];
+        uint32_t m_NumDiscontinuities[NumPIDs];
+        uint32_t m_NumTransportErrors[NumPIDs];
+        uint32_t m_NumScrambled[NumPIDs];
+        uint32_t m_NumPATErrors;
+        uint32_t m_NumPMTErrors;
+        uint32_t m_NumPIDErrors;
 
-    void Init(int32_t PID) {
-        m_PID = PID;
-        if (m_PID == 136) ofs = fopen("/home/loobson/Politechnika/rewrite/pid136.mp2", "wb");
-        else if (m_PID == 174) ofs = fopen("/home/loobson/Politechnika/rewrite/pid174.264", "wb");
-    };
+    public:
+        xTS_ContinuityMonitor() { Reset(); }
 
-    eResult AbsorbPacket(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
-                         const xTS_AdaptationField *AdaptationField) {
-        if (PacketHeader->getPacketIdentifier() == m_PID) {
-            if (PacketHeader->isPayloadUnitStartIndicator()) {
-                if (m_Started) {
-                    m_Started = false;
-                    fwrite(m_Buffer, m_BufferSize, 1, ofs);
-                    printf(" PES: Finished with previous, Len=%4d ", m_BufferSize);
-                }
+        void Reset() {
+            memset(m_State, 0, sizeof(m_State));
+            memset(m_NumPackets, 0, sizeof(m_NumPackets));
+            memset(m_NumContinuityErrors, 0, sizeof(m_NumContinuityErrors));
+            memset(m_NumDuplicates, 0, sizeof(m_NumDuplicates));
+            memset(m_NumDiscontinuities, 0, sizeof(m_NumDiscontinuities));
+            memset(m_NumTransportErrors, 0, sizeof(m_NumTransportErrors));
+            memset(m_NumScrambled, 0, sizeof(m_NumScrambled));
+            m_NumPATErrors = 0;
+            m_NumPMTErrors = 0;
+            m_NumPIDErrors = 0;
+        }
 
-                if (!m_Started) {
-                    m_Started = true;
-                    xBufferReset();
-                    m_pesOffset = m_PESH.Parse(TransportStreamPacket,
-                                                xTS::TS_HeaderLength + AdaptationField->getNumBytes());
-                    if(m_PID != 174) m_BufferSize = m_PESH.getPacketLength() - m_PESH.getPesHeaderDataLength();
-                    xBufferAppend(TransportStreamPacket, m_pesOffset);
-                    return eResult::AssemblingStarted;
-                }
-            } else {
-                if (PacketHeader->hasPayload()) {
-                    xBufferAppend(TransportStreamPacket, xTS::TS_HeaderLength + AdaptationField->getNumBytes());
-                    m_LastContinuityCounter++;
-                }
+        eResult Check(const uint8_t *Packet, const xTS_PacketHeader *Header) {
+            return Check(Packet, Header->getPacketIdentifier(), Header->getContinuityCounter(), Header->getAdaptationFieldControl(),
+                         Header->isTransportErrorIndicator(), Header->getTransportScramblingControl());
+        }
 
-                return eResult::AssemblingContinue;
+        eResult Check(const uint8_t *Packet, const xTS_PacketTable &Table, uint32_t Idx) {
+            return Check(Packet, Table.getPacketIdentifier(Idx), Table.getContinuityCounter(Idx), Table.getAdaptationFieldControl(Idx),
+                         Table.isTransportErrorIndicator(Idx), Table.getTransportScramblingControl(Idx));
+        }
+
+        eResult Check(const uint8_t *Packet, uint16_t PID, uint8_t ContinuityCounter, uint8_t AdaptationFieldControl,
+                      bool TransportErrorIndicator, uint8_t TransportScramblingControl) {
+            m_NumPackets[PID]++;
+            if (TransportErrorIndicator) {
+                m_NumTransportErrors[PID]++;
+                return eResult::TransportError;
             }
-        } else return eResult::UnexpectedPID;
+            if (TransportScramblingControl != 0) m_NumScrambled[PID]++;
+            if (PID == NullPID) return eResult::Ok;
 
-        return eResult::AssemblingStarted;
-    };
+            xState &State = m_State[PID];
+            if (!State.Seen) {
+                State.Seen = true;
+                State.LastContinuityCounter = ContinuityCounter;
+                return eResult::Ok;
+            }
 
-    void PrintPESH() const { m_PESH.Print(); }
-    uint8_t *getBuffer() const { return m_Buffer; }
-    int32_t getNumPacketBytes() const { return m_BufferSize; }
-    FILE *getOfs() const { return ofs; }
+            //discontinuity_indicator read straight from the packet, the adaptation field may not be parsed
+            if ((AdaptationFieldControl & 0b10) != 0 and Packet[4] != 0 and (Packet[5] & 0b10000000) != 0) {
+                m_NumDiscontinuities[PID]++;
+                State.LastContinuityCounter = ContinuityCounter;
+                State.Duplicated = false;
+                return eResult::Discontinuity;
+            }
 
-protected:
-    void xBufferReset() {
-        m_LastContinuityCounter = 0;
-        m_BufferSize = 0;
-        m_DataOffset = 0;
-        delete [] m_Buffer;
-        m_Buffer = nullptr;
-        m_TmpBuffer = nullptr;
-        m_pesOffset = 0;
-        m_DataOffset = 0;
+            //counter advances only with payload
+            bool HasPayload = (AdaptationFieldControl & 0b01) != 0;
+            uint8_t Expected = HasPayload ? (State.LastContinuityCounter + 1) & 0xF : State.LastContinuityCounter;
+            if (ContinuityCounter == Expected) {
+                State.LastContinuityCounter = ContinuityCounter;
+                State.Duplicated = false;
+                return eResult::Ok;
+            }
+            //a single repetition of a payload packet is allowed
+            if (HasPayload and ContinuityCounter == State.LastContinuityCounter and !State.Duplicated) {
+                State.Duplicated = true;
+                m_NumDuplicates[PID]++;
+                return eResult::Duplicate;
+            }
+            m_NumContinuityErrors[PID]++;
+            State.LastContinuityCounter = ContinuityCounter;
+            State.Duplicated = false;
+            return eResult::ContinuityError;
+        }
 
-        m_PESH.Reset();
-    };
+        static bool isLoss(eResult Result) { return Result == eResult::ContinuityError or Result == eResult::TransportError; }
 
-    void xBufferAppend(const uint8_t *Data, int32_t Size) {
-        if (m_Buffer == nullptr) {
-            if(m_PID == 174) m_BufferSize += xTS::TS_PacketLength - Size;
-            m_DataOffset += xTS::TS_PacketLength - Size;
-            m_Buffer = new uint8_t[m_BufferSize];
-            copy(Data + Size, Data + xTS::TS_PacketLength, m_Buffer);
+        void AddPATError() { m_NumPATErrors++; }
+        void AddPMTError() { m_NumPMTErrors++; }
+        void AddPIDError() { m_NumPIDErrors++; }
 
-        } else {
-            if (m_PID == 136) {
-                copy(Data + Size, Data + xTS::TS_PacketLength, m_Buffer + m_DataOffset);
-                m_DataOffset += xTS::TS_PacketLength - Size;
+        uint32_t getNumContinuityErrors(uint16_t PID) const { return m_NumContinuityErrors[PID]; }
+        uint64_t getNumPackets(uint16_t PID) const { return m_NumPackets[PID]; }
+
+        void getTotals(uint64_t &NumPackets, uint64_t &NumContinuityErrors, uint64_t &NumTransportErrors) const {
+            NumPackets = NumContinuityErrors = NumTransportErrors = 0;
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                NumPackets += m_NumPackets[PID];
+                NumContinuityErrors += m_NumContinuityErrors[PID];
+                NumTransportErrors += m_NumTransportErrors[PID];
+            }
+        }
 
-            } else if (m_PID == 174) {
-                m_BufferSize += (xTS::TS_PacketLength - Size);
-                m_TmpBuffer = new uint8_t[m_BufferSize];
-                move(m_Buffer + 0, m_Buffer + m_DataOffset, m_TmpBuffer);
+        //sums counters of monitors that observed disjoint parts of a stream
+        void Merge(const xTS_ContinuityMonitor &Other) {
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                m_NumPackets[PID] += Other.m_NumPackets[PID];
+                m_NumContinuityErrors[PID] += Other.m_NumContinuityErrors[PID];
+                m_NumDuplicates[PID] += Other.m_NumDuplicates[PID];
+                m_NumDiscontinuities[PID] += Other.m_NumDiscontinuities[PID];
+                m_NumTransportErrors[PID] += Other.m_NumTransportErrors[PID];
+                m_NumScrambled[PID] += Other.m_NumScrambled[PID];
+            }
+            m_NumPATErrors += Other.m_NumPATErrors;
+            m_NumPMTErrors += Other.m_NumPMTErrors;
+            m_NumPIDErrors += Other.m_NumPIDErrors;
+        }
 
-                delete[] m_Buffer;
-                m_Buffer = m_TmpBuffer;
+        void PrintReport(uint32_t NumSyncLosses, uint32_t NumSyncByteErrors) const {
+            uint64_t NumContinuityErrors = 0;
+            uint64_t NumTransportErrors = 0;
+            uint32_t NumPATErrors = m_NumPATErrors + (m_NumPackets[0] == 0) + m_NumScrambled[0];
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                NumContinuityErrors += m_NumContinuityErrors[PID];
+                NumTransportErrors += m_NumTransportErrors[PID];
+            }
 
-                copy(Data + Size, Data + xTS::TS_PacketLength, m_Buffer + m_DataOffset);
-                m_DataOffset += xTS::TS_PacketLength - Size;
+            printf("TR101290: 1.1 TS_sync_loss=%d 1.2 Sync_byte_error=%d 1.3 PAT_error=%d 1.4 Continuity_count_error=%lu "
+                   "1.5 PMT_error=%d 1.6 PID_error=%d 2.1 Transport_error=%lu\n", NumSyncLosses, NumSyncByteErrors,
+                   NumPATErrors, NumContinuityErrors, m_NumPMTErrors, m_NumPIDErrors, NumTransportErrors);
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                if (m_NumPackets[PID] == 0) continue;
+                printf("PID: %4d Packets=%lu CC=%d Dup=%d DI=%d TEI=%d Scrambled=%d\n", PID, m_NumPackets[PID],
+                       m_NumContinuityErrors[PID], m_NumDuplicates[PID], m_NumDiscontinuities[PID],
+                       m_NumTransportErrors[PID], m_NumScrambled[PID]);
             }
         }
-    }
 };
 
-int main( int argc, char *argv[ ], char *envp[ ]) {
-    FILE *file = fopen("/home/loobson/Politechnika/rewrite/example_new.ts", "rb");
+//PCR timing per clock PID: bitrates, repetition, accuracy (PCR_AC) and arrival jitter, TR 101 290 priority 2 style
+class xTS_ClockAnalyzer {
+    public:
+        static constexpr uint32_t NumPIDs = 8192;
+        static constexpr uint64_t ClockFrequency = 27000000;
+        static constexpr uint64_t PCRModulus = (1ull << 33) * xTS::BaseToExtendedClockMultiplier;
+        static constexpr uint32_t WindowLength = 64;                        //PCRs in rolling window, power of 2
+        static constexpr uint64_t MaxRepetitionInterval = ClockFrequency / 25;  //40 ms
+        static constexpr uint64_t MaxDiscontinuityInterval = ClockFrequency / 10; //100 ms
+        static constexpr int64_t MaxAccuracy = 500;                         //ns
 
-    if (file == nullptr) {
-        printf("wrong file name\n");
-        return EXIT_FAILURE;
-    }
+    protected:
+        struct xSample {
+            uint64_t PacketIdx;
+            uint64_t PCR;           //unwrapped since last discontinuity
+            int64_t Offset;         //PCR time - arrival time [ns], valid when m_HasArrival
+        };
 
-    uint8_t TS_PacketBuffer[xTS::TS_PacketLength];
-    xTS_PacketHeader TS_PacketHeader;
-    xTS_AdaptationField TS_PacketAdaptationField;
-    xPES_Assembler PES_Assembler136;
-    xPES_Assembler PES_Assembler174;
-    xPES_Assembler::eResult Result;
+        struct xClock {
+            uint16_t PID;
+            xSample Window[WindowLength];
+            uint64_t NumSamples;    //since last discontinuity, window holds the last WindowLength
+            //monotonic queues of sample numbers for rolling min/max of Offset
+            uint64_t MinQueue[WindowLength];
+            uint64_t MaxQueue[WindowLength];
+            uint32_t MinBegin, MinEnd, MaxBegin, MaxEnd;
+            uint64_t LastRawPCR;
+            bool HasArrival;
 
-    int32_t TS_PacketId = 0;
+            uint64_t NumPCRs;
+            uint64_t NumRepetitionErrors;
+            uint64_t NumDiscontinuityErrors;
+            uint64_t NumAccuracyErrors;
+            uint64_t NumSignalledDiscontinuities;
+            uint64_t MinInterval, MaxInterval, SumInterval, NumIntervals;
+            uint64_t TotalTicks, TotalPackets;  //summed over discontinuity free segments
+            double MinBitrate, MaxBitrate, LastBitrate;
+            int64_t MaxAbsAccuracy;
+            int64_t MaxJitter;
+            double Drift;           //ppm of PCR clock against arrival clock over window
+        };
 
-    PES_Assembler136.Init(136);
-    PES_Assembler174.Init(174);
+        int16_t m_ClockOf[NumPIDs];
+        vector<xClock *> m_Clocks;
+        bool m_HasArrival = false;
 
-    while (!feof(file)) {
-        size_t NumRead = fread(TS_PacketBuffer, 1, xTS::TS_PacketLength, file);
-        if (NumRead != xTS::TS_PacketLength) { break; }
+    public:
+        xTS_ClockAnalyzer() { memset(m_ClockOf, -1, sizeof(m_ClockOf)); }
+        ~xTS_ClockAnalyzer() {
+            for (xClock *Clock : m_Clocks) delete Clock;
+        }
 
-        TS_PacketHeader.Reset();
-        TS_PacketHeader.Parse(TS_PacketBuffer);
+        //PCR_flag read straight from the packet, the adaptation field may not be parsed
+        static bool hasPCR(const uint8_t *Packet) {
+            return (Packet[3] & 0b00100000) != 0 and Packet[4] >= 7 and (Packet[5] & 0b00010000) != 0;
+        }
 
-        if (TS_PacketHeader.getSyncByte() == 71) {
-            printf("%010d ", TS_PacketId);
-            TS_PacketHeader.Print();
-            TS_PacketAdaptationField.Reset();
+        //PacketIdx counts all packets of the multiplex, ArrivalTime in ns or -1
+        void AbsorbPCR(const uint8_t *Packet, uint16_t PID, uint64_t PacketIdx, int64_t ArrivalTime) {
+            uint64_t Base = ((uint64_t) Packet[6]) << 25 | ((uint64_t) Packet[7]) << 17 | ((uint64_t) Packet[8]) << 9 |
+                            ((uint64_t) Packet[9]) << 1 | ((uint64_t) Packet[10]) >> 7;
+            uint64_t RawPCR = Base * xTS::BaseToExtendedClockMultiplier + (((uint16_t) (Packet[10] & 0b00000001)) << 8 | Packet[11]);
+            bool DiscontinuityIndicator = (Packet[5] & 0b10000000) != 0;
 
-            if (TS_PacketHeader.hasAdaptationField()) {
-                TS_PacketAdaptationField.Parse(TS_PacketBuffer, TS_PacketHeader.getAdaptationFieldControl());
-                TS_PacketAdaptationField.Print();
+            xClock &Clock = xGetClock(PID);
+            Clock.NumPCRs++;
+            if (Clock.NumSamples == 0 or DiscontinuityIndicator) {
+                if (Clock.NumSamples != 0) Clock.NumSignalledDiscontinuities++;
+                xRestart(Clock, RawPCR, PacketIdx, ArrivalTime);
+                return;
             }
 
-            if (TS_PacketHeader.getPacketIdentifier() == 136) {
-                Result = PES_Assembler136.AbsorbPacket(TS_PacketBuffer, &TS_PacketHeader, &TS_PacketAdaptationField);
-            } else if (TS_PacketHeader.getPacketIdentifier() == 174) {
-                Result = PES_Assembler174.AbsorbPacket(TS_PacketBuffer, &TS_PacketHeader, &TS_PacketAdaptationField);
+            const xSample &Previous = Clock.Window[(Clock.NumSamples - 1) & (WindowLength - 1)];
+            uint64_t Interval = (RawPCR + PCRModulus - Clock.LastRawPCR) % PCRModulus;
+            if (Interval == 0 or Interval > MaxDiscontinuityInterval) {
+                //jump or step back without discontinuity_indicator
+                Clock.NumDiscontinuityErrors++;
+                xRestart(Clock, RawPCR, PacketIdx, ArrivalTime);
+                return;
             }
+            if (Interval > MaxRepetitionInterval) Clock.NumRepetitionErrors++;
+            if (Interval < Clock.MinInterval) Clock.MinInterval = Interval;
+            if (Interval > Clock.MaxInterval) Clock.MaxInterval = Interval;
+            Clock.SumInterval += Interval;
+            Clock.NumIntervals++;
 
+            uint64_t NumPackets = PacketIdx - Previous.PacketIdx;
+            double Bitrate = (double) NumPackets * xTS::TS_PacketLength * 8 * ClockFrequency / Interval;
+            if (Bitrate < Clock.MinBitrate) Clock.MinBitrate = Bitrate;
+            if (Bitrate > Clock.MaxBitrate) Clock.MaxBitrate = Bitrate;
+            Clock.LastBitrate = Bitrate;
+            Clock.TotalTicks += Interval;
+            Clock.TotalPackets += NumPackets;
 
-            switch (Result) {
-                case xPES_Assembler::eResult::StreamPacketLost  :
-                    printf(" PES: PcktLost");
-                    break;
-                case xPES_Assembler::eResult::AssemblingStarted :
-                    printf(" PES: Started assembling,");
-                    if (TS_PacketHeader.getPacketIdentifier() == 136) PES_Assembler136.PrintPESH();
-                    else if (TS_PacketHeader.getPacketIdentifier() == 174) PES_Assembler174.PrintPESH();
-                    break;
-                case xPES_Assembler::eResult::AssemblingContinue:
-                    printf(" PES: Continue");
-                    break;
-                case xPES_Assembler::eResult::AssemblingFinished:
-                    if (TS_PacketHeader.getPacketIdentifier() == 136)
-                        printf(" PES: Finished, Len=%4d", PES_Assembler136.getNumPacketBytes());
-                    else if (TS_PacketHeader.getPacketIdentifier() == 174)
-                        printf(" PES: Finished, Len=%4d", PES_Assembler174.getNumPacketBytes());
-                    break;
-                default:
-                    break;
+            //PCR_AC: deviation from the value a constant window bitrate predicts for this packet position
+            if (Clock.NumSamples >= 2) {
+                const xSample &Oldest = xOldest(Clock);
+                double TicksPerPacket = (double) (Previous.PCR - Oldest.PCR) / (Previous.PacketIdx - Oldest.PacketIdx);
+                double Expected = Previous.PCR + TicksPerPacket * NumPackets;
+                int64_t Accuracy = (int64_t) (((double) (Previous.PCR + Interval) - Expected) * 1000 / 27);
+                if (Accuracy < 0) Accuracy = -Accuracy;
+                if (Accuracy > MaxAccuracy) Clock.NumAccuracyErrors++;
+                if (Accuracy > Clock.MaxAbsAccuracy) Clock.MaxAbsAccuracy = Accuracy;
             }
-            printf("\n");
+
+            xPush(Clock, {PacketIdx, Previous.PCR + Interval, 0}, ArrivalTime);
+            Clock.LastRawPCR = RawPCR;
         }
-        TS_PacketId++;
-    }
-    if(PES_Assembler136.getOfs()){
-        fwrite(PES_Assembler136.getBuffer(), PES_Assembler136.getNumPacketBytes(), 1, PES_Assembler136.getOfs());
-        fclose(PES_Assembler136.getOfs());
+
+        void PrintReport(const xTS_ContinuityMonitor *Monitor) const {
+            uint64_t NumPCRErrors = 0, NumDiscontinuityErrors = 0, NumAccuracyErrors = 0;
+            const xClock *Reference = nullptr;
+            for (const xClock *Clock : m_Clocks) {
+                NumPCRErrors += Clock->NumRepetitionErrors;
+                NumDiscontinuityErrors += Clock->NumDiscontinuityErrors;
+                NumAccuracyErrors += Clock->NumAccuracyErrors;
+                if (Reference == nullptr or Clock->TotalTicks > Reference->TotalTicks) Reference = Clock;
+            }
+            printf("TR101290: 2.3a PCR_repetition_error=%lu 2.3b PCR_discontinuity_indicator_error=%lu 2.4 PCR_accuracy_error=%lu\n",
+                   NumPCRErrors, NumDiscontinuityErrors, NumAccuracyErrors);
+
+            for (const xClock *Clock : m_Clocks) {
+                printf("PCR: PID=%4d PCRs=%lu Interval[ms]=%.2f/%.2f/%.2f Bitrate[bps]=%.0f Instant[bps]=%.0f/%.0f/%.0f "
+                       "AC[ns]=%ld DI=%lu", Clock->PID, Clock->NumPCRs,
+                       Clock->NumIntervals ? Clock->MinInterval / 27000.0 : 0.0,
+                       Clock->NumIntervals ? (double) Clock->SumInterval / Clock->NumIntervals / 27000.0 : 0.0,
+                       Clock->MaxInterval / 27000.0, xAverageBitrate(*Clock),
+                       Clock->NumIntervals ? Clock->MinBitrate : 0.0, Clock->LastBitrate, Clock->MaxBitrate,
+                       Clock->MaxAbsAccuracy, Clock->NumSignalledDiscontinuities);
+                if (m_HasArrival) printf(" Jitter[ns]=%ld Drift[ppm]=%.2f", Clock->MaxJitter, Clock->Drift);
+                printf("\n");
+            }
+
+            //PID bitrates follow from their share of the multiplex timed by the longest running clock
+            if (Reference == nullptr or Reference->TotalTicks == 0 or Monitor == nullptr) return;
+            uint64_t NumPackets = 0;
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) NumPackets += Monitor->getNumPackets(PID);
+            double Bitrate = xAverageBitrate(*Reference);
+            printf("RATE: Mux=%.0f\n", Bitrate);
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                uint64_t NumPIDPackets = Monitor->getNumPackets(PID);
+                if (NumPIDPackets != 0) printf("RATE: PID=%4d Bitrate=%.0f\n", PID, Bitrate * NumPIDPackets / NumPackets);
+            }
+        }
+
+    protected:
+        xClock &xGetClock(uint16_t PID) {
+            if (m_ClockOf[PID] < 0) {
+                xClock *Clock = new xClock();
+                Clock->PID = PID;
+                Clock->MinInterval = UINT64_MAX;
+                Clock->MinBitrate = 1e300;
+                m_ClockOf[PID] = m_Clocks.size();
+                m_Clocks.push_back(Clock);
+            }
+            return *m_Clocks[m_ClockOf[PID]];
+        }
+
+        static double xAverageBitrate(const xClock &Clock) {
+            return Clock.TotalTicks ? (double) Clock.TotalPackets * xTS::TS_PacketLength * 8 * ClockFrequency / Clock.TotalTicks : 0.0;
+        }
+
+        static const xSample &xOldest(const xClock &Clock) {
+            uint64_t Oldest = Clock.NumSamples > WindowLength ? Clock.NumSamples - WindowLength : 0;
+            return Clock.Window[Oldest & (WindowLength - 1)];
+        }
+
+        void xRestart(xClock &Clock, uint64_t RawPCR, uint64_t PacketIdx, int64_t ArrivalTime) {
+            Clock.NumSamples = 0;
+            Clock.MinBegin = Clock.MinEnd = Clock.MaxBegin = Clock.MaxEnd = 0;
+            Clock.LastRawPCR = RawPCR;
+            Clock.HasArrival = ArrivalTime >= 0;
+            xPush(Clock, {PacketIdx, RawPCR, 0}, ArrivalTime);
+        }
+
+        //appends sample, keeps rolling min/max of PCR-arrival offset in O(1) amortized
+        void xPush(xClock &Clock, xSample Sample, int64_t ArrivalTime) {
+            uint64_t Number = Clock.NumSamples++;
+            if (ArrivalTime < 0 or !Clock.HasArrival) {
+                Clock.HasArrival = false;
+                Clock.Window[Number & (WindowLength - 1)] = Sample;
+                return;
+            }
+            m_HasArrival = true;
+            Sample.Offset = (int64_t) (Sample.PCR * 1000 / 27) - ArrivalTime;
+            Clock.Window[Number & (WindowLength - 1)] = Sample;
+
+            const uint32_t Mask = WindowLength - 1;
+            uint64_t Expired = Number >= WindowLength ? Number - WindowLength + 1 : 0;
+            if (Clock.MinEnd != Clock.MinBegin and Clock.MinQueue[Clock.MinBegin & Mask] < Expired) Clock.MinBegin++;
+            if (Clock.MaxEnd != Clock.MaxBegin and Clock.MaxQueue[Clock.MaxBegin & Mask] < Expired) Clock.MaxBegin++;
+            while (Clock.MinEnd != Clock.MinBegin and Clock.Window[Clock.MinQueue[(Clock.MinEnd - 1) & Mask] & Mask].Offset >= Sample.Offset) Clock.MinEnd--;
+            while (Clock.MaxEnd != Clock.MaxBegin and Clock.Window[Clock.MaxQueue[(Clock.MaxEnd - 1) & Mask] & Mask].Offset <= Sample.Offset) Clock.MaxEnd--;
+            Clock.MinQueue[Clock.MinEnd++ & Mask] = Number;
+            Clock.MaxQueue[Clock.MaxEnd++ & Mask] = Number;
+
+            //peak to peak of the offset is the PCR jitter seen at the receiver (includes network delay variation)
+            int64_t Jitter = Clock.Window[Clock.MaxQueue[Clock.MaxBegin & Mask] & Mask].Offset -
+                             Clock.Window[Clock.MinQueue[Clock.MinBegin & Mask] & Mask].Offset;
+            if (Jitter > Clock.MaxJitter) Clock.MaxJitter = Jitter;
+
+            //frequency offset of the encoder clock over the window
+            const xSample &Oldest = xOldest(Clock);
+            int64_t Elapsed = (int64_t) ((Sample.PCR - Oldest.PCR) * 1000 / 27) - (Sample.Offset - Oldest.Offset);
+            if (Elapsed > 0) Clock.Drift = (double) (Sample.Offset - Oldest.Offset) * 1e6 / Elapsed;
+        }
+};
+
+//consumer of all packets of one PID, registered in xTS_Demux
+class xTS_PacketHandler {
+    public:
+        virtual ~xTS_PacketHandler() {};
+
+        //returns handler specific result code
+        virtual int32_t Handle(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
+                               const xTS_AdaptationField *AdaptationField) = 0;
+        virtual void PrintResult(int32_t Result) const {};
+        virtual void PrintStats() const {};
+        //next packet follows lost or damaged data
+        virtual void SignalLoss() {};
+        //header of the PES started by the packet that returned Result, nullptr if none
+        virtual const xPES_PacketHeader *getStartedPESHeader(int32_t Result) const { return nullptr; }
+        //length of the PES finished by the packet that returned Result, -1 if none
+        virtual int32_t getFinishedLength(int32_t Result) const { return -1; }
+        //end of input
+        virtual void Flush() {};
+        //streaming: hold at most MaxBufferedBytes and hand data on as early as possible
+        virtual void SetStreaming(uint32_t MaxBufferedBytes) {};
+        //streaming: input went quiet, write out whatever is buffered without ending the unit
+        virtual void Drain() {};
+};
+
+//growable buffer reused across PES packets, capacity grows geometrically and is never released on Reset()
+class xPES_Buffer {
+    protected:
+        uint8_t *m_Data = nullptr;
+        uint32_t m_Size = 0;
+        uint32_t m_Capacity = 0;
+        uint32_t m_HighWaterMark = 0;
+        uint32_t m_NumAllocations = 0;
+
+    public:
+        static constexpr uint32_t MinCapacity = 64 * 1024;
+        static constexpr uint32_t MaxCapacity = 1u << 30;
+
+        xPES_Buffer() {};
+        xPES_Buffer(const xPES_Buffer &) = delete;
+        xPES_Buffer &operator=(const xPES_Buffer &) = delete;
+
+        ~xPES_Buffer() { free(m_Data); }
+
+        void Reset() { m_Size = 0; }
+
+        //a failed reservation is retried by Append()
+        void Reserve(uint32_t Capacity) {
+            if (Capacity > m_Capacity) xGrow(Capacity);
+        }
+
+        //returns false (nothing appended) when the buffer cannot grow
+        bool Append(const uint8_t *Data, uint32_t Size) {
+            if ((uint64_t) m_Size + Size > m_Capacity and !xGrow((uint64_t) m_Size + Size)) return false;
+            memcpy(m_Data + m_Size, Data, Size);
+            m_Size += Size;
+            if (m_Size > m_HighWaterMark) m_HighWaterMark = m_Size;
+            return true;
+        }
+
+        const uint8_t *getData() const { return m_Data; }
+        uint32_t getSize() const { return m_Size; }
+        uint32_t getCapacity() const { return m_Capacity; }
+        uint32_t getHighWaterMark() const { return m_HighWaterMark; }
+        uint32_t getNumAllocations() const { return m_NumAllocations; }
+
+    protected:
+        //keeps the old buffer when MaxCapacity is exceeded or realloc fails
+        bool xGrow(uint64_t Capacity) {
+            if (Capacity > MaxCapacity) return false;
+            uint64_t NewCapacity = m_Capacity < MinCapacity ? MinCapacity : m_Capacity;
+            while (NewCapacity < Capacity) NewCapacity *= 2;
+            if (NewCapacity > MaxCapacity) NewCapacity = MaxCapacity;
+            uint8_t *Data = (uint8_t *) realloc(m_Data, NewCapacity);
+            if (Data == nullptr) return false;
+            m_Data = Data;
+            m_Capacity = NewCapacity;
+            m_NumAllocations++;
+            return true;
+        }
+};
+
+//finds 00 00 01 start codes, AVX2 compares the three byte pattern 32 positions at a time
+class xES_StartCodeFinder {
+    protected:
+        typedef const uint8_t *(*xFinder)(const uint8_t *Begin, const uint8_t *End);
+        static xFinder s_Finder;
+        static const char *s_FinderName;
+
+    public:
+        //returns pointer to the 0x01 of the first start code fully inside [Begin, End), End if none
+        static const uint8_t *Find(const uint8_t *Begin, const uint8_t *End) { return s_Finder(Begin, End); }
+        static const char *getFinderName() { return s_FinderName; }
+
+    protected:
+        static const uint8_t *xFindScalar(const uint8_t *Begin, const uint8_t *End) {
+            const uint8_t *Cursor = Begin + 2;
+            while (Cursor < End) {
+                const uint8_t *One = (const uint8_t *) memchr(Cursor, 0x01, End - Cursor);
+                if (One == nullptr) return End;
+                if (One[-1] == 0 and One[-2] == 0) return One;
+                Cursor = One + 1;
+            }
+            return End;
+        }
+
+#ifdef TS_PARSER_X86
+        __attribute__((target("avx2")))
+        static const uint8_t *xFindAVX2(const uint8_t *Begin, const uint8_t *End) {
+            const __m256i Zero = _mm256_setzero_si256();
+            const __m256i One = _mm256_set1_epi8(1);
+            const uint8_t *Cursor = Begin;
+            for (; Cursor + 34 <= End; Cursor += 32) {
+                __m256i First = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) Cursor), Zero);
+                __m256i Second = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (Cursor + 1)), Zero);
+                __m256i Third = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (Cursor + 2)), One);
+                uint32_t Mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(First, Second), Third));
+                if (Mask != 0) return Cursor + __builtin_ctz(Mask) + 2;
+            }
+            return xFindScalar(Cursor, End);
+        }
+#endif
+
+        static xFinder xSelectFinder(const char **Name) {
+#ifdef TS_PARSER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                *Name = "avx2";
+                return xFindAVX2;
+            }
+#endif
+            *Name = "memchr";
+            return xFindScalar;
+        }
+};
+
+const char *xES_StartCodeFinder::s_FinderName = "memchr";
+xES_StartCodeFinder::xFinder xES_StartCodeFinder::s_Finder = xES_StartCodeFinder::xSelectFinder(&xES_StartCodeFinder::s_FinderName);
+
+//splits H.264/HEVC elementary stream into NAL units and access units, fed in place from PES payload (buffer or slices)
+//writes one CSV line per access unit: offset,size,pts,keyframe,nal_types
+class xES_AccessUnitSplitter {
+    public:
+        enum class eCodec : int32_t {
+            H264,
+            HEVC,
+        };
+
+        static constexpr int64_t NoPTS = -1;
+
+    protected:
+        eCodec m_Codec;
+        uint32_t m_NumHeaderBytes;      //NAL header + byte holding first_mb_in_slice / first_slice_segment_in_pic_flag
+        FILE *m_Output = nullptr;
+        uint16_t m_PID = 0;
+
+        uint64_t m_Position = 0;        //ES bytes fed so far
+        uint8_t m_Tail[2];              //last bytes of previous chunk, for start codes split between chunks
+        uint32_t m_NumTail = 0;
+        uint8_t m_Pending[3];           //NAL header bytes collected across chunks
+        uint32_t m_NumPending = 0;
+        uint64_t m_PendingOffset = 0;
+        bool m_HeaderPending = false;
+
+        int64_t m_PESPTS = NoPTS;       //PTS of PES not yet assigned to an access unit
+        bool m_AUOpen = false;
+        bool m_AUHasVCL = false;
+        bool m_AUKeyframe = false;
+        uint64_t m_AUOffset = 0;
+        int64_t m_AUPTS = NoPTS;
+        char m_AUTypes[96];
+        uint32_t m_AUTypesLength = 0;
+
+        uint64_t m_NumNALs = 0;
+        uint64_t m_NumAUs = 0;
+        uint64_t m_NumKeyframes = 0;
+        uint64_t m_NumParameterSets = 0;
+
+    public:
+        ~xES_AccessUnitSplitter() { Flush(); }
+
+        //codec from PMT stream_type, false if not splittable
+        static bool getCodec(uint8_t StreamType, eCodec &Codec) {
+            if (StreamType == 0x1B) Codec = eCodec::H264;
+            else if (StreamType == 0x24) Codec = eCodec::HEVC;
+            else return false;
+            return true;
+        }
+
+        int32_t Init(uint16_t PID, eCodec Codec, const char *OutputPath) {
+            m_PID = PID;
+            m_Codec = Codec;
+            m_NumHeaderBytes = Codec == eCodec::H264 ? 2 : 3;
+            m_Output = fopen(OutputPath, "wb");
+            if (m_Output == nullptr) return -1;
+            fprintf(m_Output, "offset,size,pts,keyframe,nal_types\n");
+            return 0;
+        }
+
+        //start of a PES payload, PTS applies to the first access unit starting in it
+        void BeginPES(int64_t PTS) { m_PESPTS = PTS; }
+
+        void Feed(const uint8_t *Data, size_t Size) {
+            if (Size == 0) return;
+            uint64_t Base = m_Position;
+            size_t Cursor = 0;
+
+            //header bytes of a NAL whose start code ended the previous chunk
+            while (m_HeaderPending and Cursor < Size) {
+                m_Pending[m_NumPending++] = Data[Cursor++];
+                if (m_NumPending == m_NumHeaderBytes) {
+                    m_HeaderPending = false;
+                    xNAL(m_PendingOffset, m_Pending);
+                }
+            }
+
+            //start codes with their 0x01 in the first two bytes of this chunk
+            uint8_t Stitch[4];
+            uint32_t NumStitch = m_NumTail;
+            memcpy(Stitch, m_Tail, m_NumTail);
+            for (size_t Idx = 0; Idx < 2 and Idx < Size; Idx++) Stitch[NumStitch++] = Data[Idx];
+            for (uint32_t One = 2; One < NumStitch; One++) {
+                size_t DataIdx = One - m_NumTail;
+                if (DataIdx >= 2 or Stitch[One] != 1 or Stitch[One - 1] != 0 or Stitch[One - 2] != 0) continue;
+                xStartCode(Data, Size, DataIdx, Base);
+            }
+
+            //everything else with the vectorized search
+            const uint8_t *End = Data + Size;
+            for (const uint8_t *One = xES_StartCodeFinder::Find(Data, End); One < End; One = xES_StartCodeFinder::Find(One - 1, End)) {
+                xStartCode(Data, Size, One - Data, Base);
+            }
+
+            //last two bytes of everything fed so far
+            if (Size >= 2) {
+                memcpy(m_Tail, End - 2, 2);
+                m_NumTail = 2;
+            } else if (m_NumTail == 0) {
+                m_Tail[0] = Data[0];
+                m_NumTail = 1;
+            } else {
+                m_Tail[0] = m_Tail[m_NumTail - 1];
+                m_Tail[1] = Data[0];
+                m_NumTail = 2;
+            }
+            m_Position += Size;
+        }
+
+        void Flush() {
+            if (m_AUOpen) xCloseAU(m_Position);
+            m_AUOpen = false;
+            if (m_Output != nullptr) fclose(m_Output);
+            m_Output = nullptr;
+        }
+
+        void PrintStats() const {
+            printf("AU: PID=%4d Codec=%s NALs=%lu AccessUnits=%lu Keyframes=%lu ParameterSets=%lu Search=%s\n", m_PID,
+                   m_Codec == eCodec::H264 ? "H.264" : "HEVC", m_NumNALs, m_NumAUs, m_NumKeyframes, m_NumParameterSets,
+                   xES_StartCodeFinder::getFinderName());
+        }
+
+    protected:
+        //One - index of 0x01 in Data
+        void xStartCode(const uint8_t *Data, size_t Size, size_t One, uint64_t Base) {
+            uint64_t Offset = Base + One - 2;
+            //zero_byte of a 4 byte start code belongs to the NAL, it may sit in the previous chunk
+            int64_t ZeroIdx = (int64_t) One - 3;
+            bool HasZeroByte = ZeroIdx >= 0 ? Data[ZeroIdx] == 0 : -ZeroIdx <= (int64_t) m_NumTail and m_Tail[m_NumTail + ZeroIdx] == 0;
+            if (HasZeroByte and Offset > 0) Offset--;
+            if (One + m_NumHeaderBytes < Size) {
+                xNAL(Offset, Data + One + 1);
+                return;
+            }
+            m_NumPending = Size - One - 1;
+            memcpy(m_Pending, Data + One + 1, m_NumPending);
+            m_PendingOffset = Offset;
+            m_HeaderPending = true;
+        }
+
+        void xNAL(uint64_t Offset, const uint8_t *Header) {
+            uint32_t Type;
+            bool VCL, FirstSlice, Prefix, Keyframe, ParameterSet;
+            if (m_Codec == eCodec::H264) {
+                Type = Header[0] & 0x1F;
+                VCL = Type >= 1 and Type <= 5;
+                FirstSlice = VCL and (Header[1] & 0x80) != 0;      //first_mb_in_slice == 0
+                Prefix = Type == 6 or Type == 7 or Type == 8 or Type == 9 or (Type >= 14 and Type <= 18);
+                Keyframe = Type == 5;
+                ParameterSet = Type == 7 or Type == 8;
+            } else {
+                Type = (Header[0] >> 1) & 0x3F;
+                VCL = Type < 32;
+                FirstSlice = VCL and (Header[2] & 0x80) != 0;      //first_slice_segment_in_pic_flag
+                Prefix = (Type >= 32 and Type <= 35) or Type == 39 or (Type >= 41 and Type <= 44) or (Type >= 48 and Type <= 55);
+                Keyframe = Type >= 16 and Type <= 23;
+                ParameterSet = Type >= 32 and Type <= 34;
+            }
+            m_NumNALs++;
+            if (ParameterSet) m_NumParameterSets++;
+
+            //new access unit: first prefix NAL or first slice of a picture after the previous picture's slices
+            if (!m_AUOpen or (m_AUHasVCL and (Prefix or FirstSlice))) {
+                if (m_AUOpen) xCloseAU(Offset);
+                m_AUOpen = true;
+                m_AUHasVCL = false;
+                m_AUKeyframe = false;
+                m_AUOffset = Offset;
+                m_AUPTS = m_PESPTS;
+                m_PESPTS = NoPTS;
+                m_AUTypesLength = 0;
+            }
+            m_AUHasVCL |= VCL;
+            m_AUKeyframe |= Keyframe;
+            if (m_AUTypesLength + 4 < sizeof(m_AUTypes)) {
+                m_AUTypesLength += snprintf(m_AUTypes + m_AUTypesLength, sizeof(m_AUTypes) - m_AUTypesLength,
+                                            m_AUTypesLength ? ";%u" : "%u", Type);
+            }
+        }
+
+        void xCloseAU(uint64_t End) {
+            m_NumAUs++;
+            if (m_AUKeyframe) m_NumKeyframes++;
+            if (m_Output == nullptr) return;
+            m_AUTypes[m_AUTypesLength] = '\0';
+            if (m_AUPTS != NoPTS) {
+                fprintf(m_Output, "%lu,%lu,%ld,%d,%s\n", m_AUOffset, End - m_AUOffset, m_AUPTS, m_AUKeyframe, m_AUTypes);
+            } else {
+                fprintf(m_Output, "%lu,%lu,,%d,%s\n", m_AUOffset, End - m_AUOffset, m_AUKeyframe, m_AUTypes);
+            }
+        }
+};
+
+//common part of PES assemblers: result codes, output file, statistics, loss bookkeeping
+class xPES_Assembler : public xTS_PacketHandler {
+public:
+    enum class eResult : int32_t {
+        UnexpectedPID = 1,
+        StreamPacketLost,
+        AssemblingStarted,
+        AssemblingContinue,
+        AssemblingFinished,
+    };
+
+protected:
+    //setup
+    int32_t m_PID;
+    uint8_t m_StreamType = 0;   //the specialization was picked for, 0 - unknown
+    FILE *ofs = nullptr;
+    uint32_t m_ExpectedSize;    //payload length announced in PES header, UINT32_MAX if unbounded
+    uint32_t m_pesOffset;
+    //operation
+    bool m_Started = false;
+    bool m_LossPending = false;
+    bool m_Corrupt = false;         //current PES misses data
+    bool m_DropCorrupt = false;
+    uint32_t m_NumPES = 0;
+    uint32_t m_NumCorruptPES = 0;
+    int32_t m_NumPreviousBytes = -1;    //length of PES finished by the last PUSI, -1 if none
+    xPES_PacketHeader m_PESH;
+    bool m_HasPESH = false;             //header parsed in full
+    xES_AccessUnitSplitter *m_Splitter = nullptr;   //optional, fed with every written PES
+    //streaming
+    bool m_Streaming = false;
+    uint32_t m_MaxBufferedBytes = UINT32_MAX;   //payload beyond is written before the PES ends
+    uint32_t m_NumDrainedBytes = 0;             //bytes of the open PES already written
+    inline static int s_StandardOutput = -1;    //original stdout once an output went to "-"
+
+public:
+    xPES_Assembler() {};
+
+    virtual ~xPES_Assembler() {
+        if (ofs != nullptr) fclose(ofs);
+        delete m_Splitter;
+    };
+
+    //assembler takes ownership, PTS of access units needs the full header policy
+    void AttachSplitter(xES_AccessUnitSplitter *Splitter) {
+        delete m_Splitter;
+        m_Splitter = Splitter;
+    }
+    bool hasSplitter() const { return m_Splitter != nullptr; }
+
+    void SetStreamType(uint8_t StreamType) { m_StreamType = StreamType; }
+    uint8_t getStreamType() const { return m_StreamType; }
+
+    //continues output, counters and the open PES of an assembler of another specialization, payload it
+    //buffered is written out first
+    void TakeOver(xPES_Assembler *Other) {
+        Other->Drain();
+        ofs = Other->ofs;
+        Other->ofs = nullptr;
+        m_Splitter = Other->m_Splitter;
+        Other->m_Splitter = nullptr;
+        m_PID = Other->m_PID;
+        m_ExpectedSize = Other->m_ExpectedSize;
+        m_pesOffset = Other->m_pesOffset;
+        m_Started = Other->m_Started;
+        m_LossPending = Other->m_LossPending;
+        m_Corrupt = Other->m_Corrupt;
+        m_DropCorrupt = Other->m_DropCorrupt;
+        m_NumPES = Other->m_NumPES;
+        m_NumCorruptPES = Other->m_NumCorruptPES;
+        m_NumPreviousBytes = Other->m_NumPreviousBytes;
+        m_PESH = Other->m_PESH;
+        m_HasPESH = Other->m_HasPESH;
+        m_Streaming = Other->m_Streaming;
+        m_MaxBufferedBytes = Other->m_MaxBufferedBytes;
+        m_NumDrainedBytes = Other->m_NumDrainedBytes;
+    }
+
+    //OutputPath == nullptr leaves writing to a derived class, "-" takes standard output over and moves the
+    //diagnostics printed to stdout onto stderr
+    int32_t Init(int32_t PID, const char *OutputPath, bool DropCorrupt = false) {
+        m_PID = PID;
+        m_DropCorrupt = DropCorrupt;
+        if (OutputPath == nullptr) return 0;
+        if (strcmp(OutputPath, "-") == 0) {
+            if (s_StandardOutput < 0) {
+                fflush(stdout);
+                s_StandardOutput = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+            }
+            int FileDescriptor = dup(s_StandardOutput);
+            ofs = FileDescriptor >= 0 ? fdopen(FileDescriptor, "wb") : nullptr;
+        } else {
+            ofs = fopen(OutputPath, "wb");
+        }
+        return ofs != nullptr ? 0 : -1;
+    };
+
+    //bounded PES are written as soon as complete instead of at the next PUSI, payload is written in parts
+    //once MaxBufferedBytes are held and output is flushed after every write; parts already written stay
+    //even if the PES turns out corrupt and -D is given
+    void SetStreaming(uint32_t MaxBufferedBytes) override {
+        m_Streaming = true;
+        m_MaxBufferedBytes = MaxBufferedBytes;
+    }
+
+    void PrintResult(int32_t Result) const override {
+        switch ((eResult) Result) {
+            case eResult::StreamPacketLost  :
+                printf(" PES: PcktLost");
+                break;
+            case eResult::AssemblingStarted :
+                if (m_NumPreviousBytes >= 0) printf(" PES: Finished with previous, Len=%4d ", m_NumPreviousBytes);
+                printf(" PES: Started assembling,");
+                if (m_HasPESH) PrintPESH();
+                break;
+            case eResult::AssemblingContinue:
+                printf(" PES: Continue");
+                break;
+            case eResult::AssemblingFinished:
+                printf(" PES: Finished, Len=%4d", getNumPacketBytes());
+                break;
+            default:
+                break;
+        }
+    }
+
+    void SignalLoss() override {
+        m_LossPending = true;
+        if (m_Started) m_Corrupt = true;
+    }
+
+    const xPES_PacketHeader *getStartedPESHeader(int32_t Result) const override {
+        return (eResult) Result == eResult::AssemblingStarted and m_HasPESH ? &m_PESH : nullptr;
+    }
+
+    int32_t getFinishedLength(int32_t Result) const override {
+        if ((eResult) Result == eResult::AssemblingFinished) return getNumPacketBytes();
+        return (eResult) Result == eResult::AssemblingStarted ? m_NumPreviousBytes : -1;
+    }
+
+    //reuse for another input after Flush(): state and counters start over, buffers keep their capacity
+    int32_t Reopen(const char *OutputPath) {
+        if (ofs != nullptr) fclose(ofs);
+        ofs = nullptr;
+        m_Started = false;
+        m_LossPending = false;
+        m_Corrupt = false;
+        m_NumPES = 0;
+        m_NumCorruptPES = 0;
+        m_NumPreviousBytes = -1;
+        m_HasPESH = false;
+        return Init(m_PID, OutputPath, m_DropCorrupt);
+    }
+
+    void PrintPESH() const { m_PESH.Print(); }
+    virtual int32_t getNumPacketBytes() const = 0;
+    FILE *getOfs() const { return ofs; }
+    uint32_t getNumPES() const { return m_NumPES; }
+    uint32_t getNumCorruptPES() const { return m_NumCorruptPES; }
+
+    //writev() in IOV_MAX batches, resumes after partial writes (modifies Slices)
+    static int32_t WriteSlices(int FileDescriptor, iovec *Slices, size_t NumSlices) {
+        while (NumSlices > 0) {
+            int NumBatch = NumSlices < IOV_MAX ? NumSlices : IOV_MAX;
+            ssize_t NumWritten = writev(FileDescriptor, Slices, NumBatch);
+            if (NumWritten < 0 and errno == EINTR) continue;
+            if (NumWritten < 0) return -1;
+            while (NumSlices > 0 and (size_t) NumWritten >= Slices->iov_len) {
+                NumWritten -= Slices->iov_len;
+                Slices++;
+                NumSlices--;
+            }
+            if (NumWritten > 0) {
+                Slices->iov_base = (uint8_t *) Slices->iov_base + NumWritten;
+                Slices->iov_len -= NumWritten;
+            }
+        }
+        return 0;
+    }
+};
+
+//length policies: bounded PES stop at PES_packet_length (0 still means unbounded), unbounded ones (video) only end at the next PUSI
+struct xPES_BoundedLength { static constexpr bool Clamp = true; };
+struct xPES_UnboundedLength { static constexpr bool Clamp = false; };
+
+//header policies: full parse (PTS/DTS for logging) or just the lengths needed to find the payload
+struct xPES_FullHeader { static constexpr bool Full = true; };
+struct xPES_MinimalHeader { static constexpr bool Full = false; };
+
+//sink policy: payload copied into a growable buffer
+class xPES_CopySink {
+protected:
+    xPES_Buffer m_Buffer;
+
+    void xSinkReset() { m_Buffer.Reset(); }
+    void xSinkReserve(uint32_t Size) { m_Buffer.Reserve(Size); }
+    bool xSinkAppend(const uint8_t *Data, uint32_t Size) { return m_Buffer.Append(Data, Size); }
+    uint32_t xSinkSize() const { return m_Buffer.getSize(); }
+    void xSinkWrite(FILE *File) { fwrite(m_Buffer.getData(), m_Buffer.getSize(), 1, File); }
+    void xSinkFeed(xES_AccessUnitSplitter *Splitter) const { Splitter->Feed(m_Buffer.getData(), m_Buffer.getSize()); }
+    void xSinkPrintStats() const {
+        printf(" Capacity=%d HighWaterMark=%d Allocations=%d", m_Buffer.getCapacity(), m_Buffer.getHighWaterMark(),
+               m_Buffer.getNumAllocations());
+    }
+
+public:
+    const uint8_t *getBuffer() const { return m_Buffer.getData(); }
+    const xPES_Buffer &getPESBuffer() const { return m_Buffer; }
+};
+
+//sink policy: zero copy, payload described as slices of packets kept alive by the input (mmap)
+class xPES_SliceSink {
+protected:
+    vector<iovec> m_Slices;
+    uint32_t m_NumSliceBytes = 0;
+    uint32_t m_MaxNumSlices = 0;
+
+    xPES_SliceSink() { m_Slices.reserve(1024); }
+
+    void xSinkReset() {
+        m_Slices.clear();
+        m_NumSliceBytes = 0;
+    }
+    void xSinkReserve(uint32_t Size) {}
+    bool xSinkAppend(const uint8_t *Data, uint32_t Size) {
+        if (Size == 0) return true;
+        m_Slices.push_back({(void *) Data, Size});
+        m_NumSliceBytes += Size;
+        return true;
+    }
+    uint32_t xSinkSize() const { return m_NumSliceBytes; }
+    void xSinkFeed(xES_AccessUnitSplitter *Splitter) const {
+        for (const iovec &Slice : m_Slices) Splitter->Feed((const uint8_t *) Slice.iov_base, Slice.iov_len);
+    }
+    void xSinkWrite(FILE *File) {
+        if (m_Slices.size() > m_MaxNumSlices) m_MaxNumSlices = m_Slices.size();
+        xPES_Assembler::WriteSlices(fileno(File), m_Slices.data(), m_Slices.size());
+    }
+    void xSinkPrintStats() const { printf(" ZeroCopy MaxSlices=%d SliceCapacity=%zu", m_MaxNumSlices, m_Slices.capacity()); }
+};
+
+//assembler specialized at compile time, the per packet path has no branches on stream properties; streaming,
+//the access unit splitter and pending loss stay runtime flags as they are set after construction
+template <class tLength, class tSink, class tHeader>
+class xPES_AssemblerT : public xPES_Assembler, protected tSink {
+public:
+    eResult AbsorbPacket(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
+                         const xTS_AdaptationField *AdaptationField) {
+        if (PacketHeader->getPacketIdentifier() != m_PID) return eResult::UnexpectedPID;
+
+        if (PacketHeader->isPayloadUnitStartIndicator()) {
+            m_NumPreviousBytes = -1;
+            m_LossPending = false;
+            if (m_Started) {
+                xFinish();
+                m_NumPreviousBytes = getNumPacketBytes();
+            }
+            m_Started = true;
+            xBufferReset();
+            xParseHeader(TransportStreamPacket, xTS::TS_HeaderLength + AdaptationField->getNumBytes());
+            if (m_ExpectedSize != UINT32_MAX) tSink::xSinkReserve(m_ExpectedSize < m_MaxBufferedBytes ? m_ExpectedSize : m_MaxBufferedBytes);
+            xBufferAppend(TransportStreamPacket, m_pesOffset);
+            if (m_Streaming and m_Started) xStream();
+            return eResult::AssemblingStarted;
+        }
+
+        if (PacketHeader->hasPayload() and m_Started) {
+            xBufferAppend(TransportStreamPacket, xTS::TS_HeaderLength + AdaptationField->getNumBytes());
+            if (m_Streaming and m_Started and xStream()) {
+                m_LossPending = false;
+                return eResult::AssemblingFinished;
+            }
+        }
+        if (m_LossPending) {
+            m_LossPending = false;
+            return eResult::StreamPacketLost;
+        }
+        return eResult::AssemblingContinue;
+    };
+
+    int32_t Handle(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
+                   const xTS_AdaptationField *AdaptationField) override {
+        return (int32_t) AbsorbPacket(TransportStreamPacket, PacketHeader, AdaptationField);
+    }
+
+    void PrintStats() const override {
+        printf("PES: PID=%4d NumPES=%d Corrupt=%d%s", m_PID, m_NumPES, m_NumCorruptPES, m_DropCorrupt ? "(dropped)" : "");
+        tSink::xSinkPrintStats();
+        printf("\n");
+        if (m_Splitter != nullptr) m_Splitter->PrintStats();
+    }
+
+    void Flush() override {
+        if (ofs == nullptr) return;
+        if (m_Started) xFinish();
+        m_Started = false;
+        fclose(ofs);
+        ofs = nullptr;
+        if (m_Splitter != nullptr) m_Splitter->Flush();
+    }
+
+    void Drain() override {
+        if (ofs == nullptr) return;
+        if (m_Started and tSink::xSinkSize() != 0) xDrain();
+        fflush(ofs);
+    }
+
+    int32_t getNumPacketBytes() const override { return m_NumDrainedBytes + tSink::xSinkSize(); }
+
+protected:
+    void xBufferReset() {
+        m_Corrupt = false;
+        m_ExpectedSize = UINT32_MAX;
+        m_pesOffset = 0;
+        m_NumDrainedBytes = 0;
+        tSink::xSinkReset();
+    };
+
+    void xParseHeader(const uint8_t *Packet, uint32_t Offset) {
+        uint32_t PacketLength, HeaderLength;
+        if constexpr (tHeader::Full) {
+            m_PESH.Reset();
+            m_pesOffset = m_PESH.Parse(Packet, Offset);
+            m_HasPESH = true;
+            PacketLength = m_PESH.hasUnboundedLength() ? 0 : m_PESH.getPacketLength();
+            HeaderLength = m_PESH.getPesHeaderDataLength();
+        } else {
+            HeaderLength = xPES_PacketHeader::ParseHeaderLength(Packet, Offset, PacketLength);
+            m_pesOffset = Offset + HeaderLength;
+        }
+        if (PacketLength != 0) m_ExpectedSize = PacketLength > HeaderLength ? PacketLength - HeaderLength : 0;
+    }
+
+    void xBufferAppend(const uint8_t *Data, uint32_t Offset) {
+        if (Offset >= xTS::TS_PacketLength) return;
+        uint32_t NumBytes = xTS::TS_PacketLength - Offset;
+        //a damaged or resynchronized stream must not overrun the announced PES length
+        if constexpr (tLength::Clamp) {
+            uint32_t Size = m_NumDrainedBytes + tSink::xSinkSize();
+            if (Size + NumBytes > m_ExpectedSize) NumBytes = m_ExpectedSize - Size;
+        }
+        if (!tSink::xSinkAppend(Data + Offset, NumBytes)) {
+            //out of memory: the PES ends here as corrupt, packets up to the next PUSI are ignored
+            m_Corrupt = true;
+            xFinish();
+        }
+    }
+
+    //streaming: finishes a complete bounded PES (returns true) or writes out the buffer when it reached the cap
+    bool xStream() {
+        if constexpr (tLength::Clamp) {
+            if (m_ExpectedSize != UINT32_MAX and m_NumDrainedBytes + tSink::xSinkSize() >= m_ExpectedSize) {
+                xFinish();
+                return true;
+            }
+        }
+        if (tSink::xSinkSize() >= m_MaxBufferedBytes) xDrain();
+        return false;
+    }
+
+    void xDrain() {
+        xTS_Instrument::xScope Probe(xTS_Instrument::eStage::Output);
+        uint32_t Size = tSink::xSinkSize();
+        xWritePayload();
+        m_NumDrainedBytes += Size;
+        tSink::xSinkReset();
+    }
+
+    //a PES written in parts starts the access unit splitter once
+    void xWritePayload() {
+        //before writing, a partial writev() modifies the slices
+        if (m_Splitter != nullptr) {
+            if (m_NumDrainedBytes == 0) m_Splitter->BeginPES(m_HasPESH and m_PESH.hasPTS() ? (int64_t) m_PESH.getPTS() : xES_AccessUnitSplitter::NoPTS);
+            tSink::xSinkFeed(m_Splitter);
+        }
+        tSink::xSinkWrite(ofs);
+        if (m_Streaming) fflush(ofs);
+    }
+
+    void xFinish() {
+        m_Started = false;
+        if (m_Corrupt) {
+            m_NumCorruptPES++;
+            if (m_DropCorrupt) return;
+        }
+        xBufferWrite();
+    }
+
+    virtual void xBufferWrite() {
+        xTS_Instrument::xScope Probe(xTS_Instrument::eStage::Output);
+        xTS_Instrument::CountPES(m_PID);
+        xWritePayload();
+        m_NumPES++;
+    }
+};
+
+//picks the assembler specialization for a stream
+class xPES_AssemblerFactory {
+public:
+    //video stream types, PES_packet_length is mostly 0 and never used to end the PES
+    static bool isUnboundedStreamType(uint8_t StreamType) {
+        switch (StreamType) {
+            case 0x01: case 0x02: case 0x10: case 0x1B: case 0x20: case 0x24: case 0x42: case 0xEA:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    //StreamType 0 - unknown, the bounded policy still handles PES_packet_length == 0 and is replaced by Retype()
+    //once the PMT is known, ZeroCopy requires packets to stay valid until the PES is written, ParseHeader is needed
+    //for PTS/DTS in logs
+    static xPES_Assembler *Create(int32_t PID, const char *OutputPath, uint8_t StreamType, bool ZeroCopy, bool DropCorrupt,
+                                  bool ParseHeader) {
+        xPES_Assembler *Assembler = isUnboundedStreamType(StreamType) ? xCreate<xPES_UnboundedLength>(ZeroCopy, ParseHeader)
+                                                                      : xCreate<xPES_BoundedLength>(ZeroCopy, ParseHeader);
+        Assembler->SetStreamType(StreamType);
+        if (Assembler->Init(PID, OutputPath, DropCorrupt) != 0) {
+            delete Assembler;
+            return nullptr;
+        }
+        return Assembler;
+    }
+
+    //assembler of a stream whose type was unknown when it was created, nullptr if the policy already fits
+    static xPES_Assembler *Retype(xPES_Assembler *Assembler, uint8_t StreamType, bool ZeroCopy, bool ParseHeader) {
+        if (Assembler->getStreamType() != 0 or !isUnboundedStreamType(StreamType)) return nullptr;
+        xPES_Assembler *Retyped = xCreate<xPES_UnboundedLength>(ZeroCopy, ParseHeader);
+        Retyped->SetStreamType(StreamType);
+        Retyped->TakeOver(Assembler);
+        return Retyped;
+    }
+
+protected:
+    template <class tLength>
+    static xPES_Assembler *xCreate(bool ZeroCopy, bool ParseHeader) {
+        return ZeroCopy ? xCreate<tLength, xPES_SliceSink>(ParseHeader) : xCreate<tLength, xPES_CopySink>(ParseHeader);
+    }
+
+    template <class tLength, class tSink>
+    static xPES_Assembler *xCreate(bool ParseHeader) {
+        if (ParseHeader) return new xPES_AssemblerT<tLength, tSink, xPES_FullHeader>;
+        return new xPES_AssemblerT<tLength, tSink, xPES_MinimalHeader>;
+    }
+};
+
+//told by a live input that no data arrived for a while
+class xTS_IdleConsumer {
+    public:
+        virtual ~xTS_IdleConsumer() {};
+        virtual void AbsorbIdle() = 0;
+};
+
+//routes packets to handlers through a flat table indexed by the 13-bit PID
+class xTS_Demux : public xTS_IdleConsumer {
+    public:
+        static constexpr uint32_t NumPIDs = 8192;
+
+    protected:
+        xTS_PacketHandler *m_Handlers[NumPIDs] = {};    //nullptr - drop
+        uint32_t m_NumHandlers = 0;
+        uint32_t m_MaxBufferedBytes = 0;                //streaming cap per PID, 0 - not streaming
+
+    public:
+        ~xTS_Demux() { Reset(); }
+
+        //demux takes ownership of the handler
+        int32_t Register(uint16_t PID, xTS_PacketHandler *Handler) {
+            if (PID >= NumPIDs or m_Handlers[PID] != nullptr) return -1;
+            m_Handlers[PID] = Handler;
+            m_NumHandlers++;
+            if (m_MaxBufferedBytes != 0) Handler->SetStreaming(m_MaxBufferedBytes);
+            return 0;
+        }
+
+        //applies to handlers registered so far and later (PMT driven)
+        void SetStreaming(uint32_t MaxBufferedBytes) {
+            m_MaxBufferedBytes = MaxBufferedBytes;
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                if (m_Handlers[PID] != nullptr) m_Handlers[PID]->SetStreaming(MaxBufferedBytes);
+            }
+        }
+
+        void Drain() {
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                if (m_Handlers[PID] != nullptr) m_Handlers[PID]->Drain();
+            }
+        }
+
+        void AbsorbIdle() override { Drain(); }
+
+        void Reset() {
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                delete m_Handlers[PID];
+                m_Handlers[PID] = nullptr;
+            }
+            m_NumHandlers = 0;
+        }
+
+        //unregisters the handler and hands ownership back, nullptr if none
+        xTS_PacketHandler *Detach(uint16_t PID) {
+            xTS_PacketHandler *Handler = m_Handlers[PID];
+            if (Handler != nullptr) m_NumHandlers--;
+            m_Handlers[PID] = nullptr;
+            return Handler;
+        }
+
+        void PrintStats() const {
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                if (m_Handlers[PID] != nullptr) m_Handlers[PID]->PrintStats();
+            }
+        }
+
+        xTS_PacketHandler *getHandler(uint16_t PID) const { return m_Handlers[PID]; }
+        uint32_t getNumHandlers() const { return m_NumHandlers; }
+
+        void Flush() {
+            for (uint32_t PID = 0; PID < NumPIDs; PID++) {
+                if (m_Handlers[PID] != nullptr) m_Handlers[PID]->Flush();
+            }
+        }
+
+        //PID given in "PID[:path]" form, path defaults to pid<PID>.es, returns output path or nullptr
+        static const char *ParseArgument(const char *Argument, int32_t &PID, char *DefaultPath, size_t DefaultPathSize) {
+            char *End;
+            long Value = strtol(Argument, &End, 0);
+            if (End == Argument or Value < 0 or Value >= NumPIDs or (*End != '\0' and *End != ':')) return nullptr;
+
+            PID = Value;
+            snprintf(DefaultPath, DefaultPathSize, "pid%ld.es", Value);
+            return *End == ':' ? End + 1 : DefaultPath;
+        }
+
+        //returns registered PID or -1
+        int32_t RegisterFromArgument(const char *Argument, bool ZeroCopy = false, bool DropCorrupt = false, bool ParseHeader = true,
+                                     uint8_t StreamType = 0) {
+            int32_t PID;
+            char DefaultPath[32];
+            const char *OutputPath = ParseArgument(Argument, PID, DefaultPath, sizeof(DefaultPath));
+            if (OutputPath == nullptr) return -1;
+
+            xPES_Assembler *Assembler = xPES_AssemblerFactory::Create(PID, OutputPath, StreamType, ZeroCopy, DropCorrupt, ParseHeader);
+            if (Assembler == nullptr) return -1;
+            if (Register(PID, Assembler) != 0) {
+                delete Assembler;
+                return -1;
+            }
+            return PID;
+        }
+};
+
+//CRC-32/MPEG-2 (poly 0x04C11DB7, not reflected, no final xor), slicing-by-8
+class xPSI_CRC32 {
+    protected:
+        static uint32_t s_Table[8][256];
+        static bool s_Initialized;
+
+    public:
+        //over a whole section including its CRC_32 field the result is 0
+        static uint32_t Compute(const uint8_t *Data, size_t Length, uint32_t CRC = 0xFFFFFFFF) {
+            while (Length >= 8) {
+                uint32_t Word = (uint32_t) Data[0] << 24 | (uint32_t) Data[1] << 16 | (uint32_t) Data[2] << 8 | Data[3];
+                Word ^= CRC;
+                CRC = s_Table[7][Word >> 24] ^ s_Table[6][(Word >> 16) & 0xFF] ^ s_Table[5][(Word >> 8) & 0xFF] ^
+                      s_Table[4][Word & 0xFF] ^ s_Table[3][Data[4]] ^ s_Table[2][Data[5]] ^ s_Table[1][Data[6]] ^
+                      s_Table[0][Data[7]];
+                Data += 8;
+                Length -= 8;
+            }
+            while (Length-- > 0) {
+                CRC = (CRC << 8) ^ s_Table[0][(CRC >> 24) ^ *Data++];
+            }
+            return CRC;
+        }
+
+    protected:
+        static bool xInit() {
+            for (uint32_t Byte = 0; Byte < 256; Byte++) {
+                uint32_t CRC = Byte << 24;
+                for (uint32_t Bit = 0; Bit < 8; Bit++) CRC = (CRC & 0x80000000) ? (CRC << 1) ^ 0x04C11DB7 : CRC << 1;
+                s_Table[0][Byte] = CRC;
+            }
+            for (uint32_t Slice = 1; Slice < 8; Slice++) {
+                for (uint32_t Byte = 0; Byte < 256; Byte++) {
+                    uint32_t Previous = s_Table[Slice - 1][Byte];
+                    s_Table[Slice][Byte] = (Previous << 8) ^ s_Table[0][Previous >> 24];
+                }
+            }
+            return true;
+        }
+};
+
+uint32_t xPSI_CRC32::s_Table[8][256];
+bool xPSI_CRC32::s_Initialized = xPSI_CRC32::xInit();
+
+//receiver of complete PSI sections
+class xPSI_SectionConsumer {
+    public:
+        virtual ~xPSI_SectionConsumer() {};
+
+        virtual void AbsorbSection(uint16_t PID, const uint8_t *Section, uint32_t Length, bool ValidCRC) = 0;
+};
+
+//reassembles sections (pointer_field, multi packet sections, several sections per packet) of one PID
+class xPSI_SectionAssembler : public xTS_PacketHandler {
+    public:
+        static constexpr uint32_t MaxSectionLength = 4096;
+        static constexpr uint8_t StuffingTableId = 0xFF;
+
+    protected:
+        uint16_t m_PID;
+        xPSI_SectionConsumer *m_Consumer;
+        uint8_t m_Buffer[MaxSectionLength + xTS::TS_PacketLength];
+        uint32_t m_Size = 0;
+        bool m_Started = false;
+        uint32_t m_NumSections = 0;
+        uint32_t m_NumCRCErrors = 0;
+
+    public:
+        xPSI_SectionAssembler(uint16_t PID, xPSI_SectionConsumer *Consumer) : m_PID(PID), m_Consumer(Consumer) {};
+
+        //returns number of sections completed by the packet
+        int32_t Handle(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
+                       const xTS_AdaptationField *AdaptationField) override {
+            if (!PacketHeader->hasPayload()) return 0;
+            uint32_t Offset = xTS::TS_HeaderLength + AdaptationField->getNumBytes();
+            if (Offset >= xTS::TS_PacketLength) return 0;
+            int32_t NumSections = 0;
+
+            if (PacketHeader->isPayloadUnitStartIndicator()) {
+                uint32_t PointerField = TransportStreamPacket[Offset++];
+                if (Offset + PointerField > xTS::TS_PacketLength) {
+                    m_Started = false;
+                    return 0;
+                }
+                //tail of the section started in an earlier packet
+                if (m_Started) NumSections += xAppend(TransportStreamPacket + Offset, PointerField);
+                Offset += PointerField;
+                m_Started = true;
+                m_Size = 0;
+            } else if (!m_Started) {
+                return 0;
+            }
+
+            NumSections += xAppend(TransportStreamPacket + Offset, xTS::TS_PacketLength - Offset);
+            return NumSections;
+        }
+
+        void PrintResult(int32_t Result) const override {
+            if (Result > 0) printf(" PSI: Sections=%d", Result);
+        }
+
+        void PrintStats() const override {
+            printf("PSI: PID=%4d Sections=%d CRCErrors=%d\n", m_PID, m_NumSections, m_NumCRCErrors);
+        }
+
+        void SignalLoss() override {
+            m_Started = false;
+            m_Size = 0;
+        }
+
+    protected:
+        int32_t xAppend(const uint8_t *Data, uint32_t Size) {
+            memcpy(m_Buffer + m_Size, Data, Size);
+            m_Size += Size;
+
+            int32_t NumSections = 0;
+            uint32_t Begin = 0;
+            while (m_Size - Begin >= 3) {
+                const uint8_t *Section = m_Buffer + Begin;
+                if (Section[0] == StuffingTableId) {
+                    m_Started = false;
+                    Begin = m_Size;
+                    break;
+                }
+                uint32_t Length = 3 + (((uint32_t) (Section[1] & 0x0F)) << 8 | Section[2]);
+                if (Length > MaxSectionLength) {
+                    m_Started = false;
+                    Begin = m_Size;
+                    break;
+                }
+                if (m_Size - Begin < Length) break;
+
+                bool SectionSyntaxIndicator = (Section[1] & 0b10000000) != 0;
+                bool ValidCRC = !SectionSyntaxIndicator or xPSI_CRC32::Compute(Section, Length) == 0;
+                if (!ValidCRC) m_NumCRCErrors++;
+                m_NumSections++;
+                NumSections++;
+                m_Consumer->AbsorbSection(m_PID, Section, Length, ValidCRC);
+                Begin += Length;
+            }
+
+            if (Begin != 0) {
+                memmove(m_Buffer, m_Buffer + Begin, m_Size - Begin);
+                m_Size -= Begin;
+            }
+            if (m_Size > MaxSectionLength) {
+                m_Started = false;
+                m_Size = 0;
+            }
+            return NumSections;
+        }
+};
+
+//follows PAT and PMTs, registers section assemblers for PMT PIDs and (optionally) PES assemblers for elementary streams
+class xTS_ServiceDiscovery : public xPSI_SectionConsumer {
+    public:
+        static constexpr uint16_t PATPID = 0;
+        static constexpr uint8_t PATTableId = 0x00;
+        static constexpr uint8_t PMTTableId = 0x02;
+        static constexpr uint8_t NoVersion = 0xFF;
+
+        struct xProgram {
+            uint16_t ProgramNumber;
+            uint16_t PMTPID;
+            uint16_t PCRPID;
+            bool Known;             //PMT received
+            uint8_t PATSection;     //section_number of the PAT listing the program
+            uint8_t PMTVersion;     //one PID may carry the PMTs of several programs
+        };
+
+    protected:
+        xTS_Demux *m_Demux;
+        xTS_ContinuityMonitor *m_Monitor;
+        bool m_AutoExtract = false;
+        bool m_ZeroCopy = false;
+        bool m_DropCorrupt = false;
+        bool m_ParseHeader = true;
+        bool m_SplitAccessUnits = false;
+
+        uint8_t m_PATVersion[256];                  //per section_number
+        uint8_t m_StreamType[xTS_Demux::NumPIDs];   //0 - not an elementary stream
+        vector<uint16_t> m_StreamProgram = vector<uint16_t>(xTS_Demux::NumPIDs, 0);  //program_number of each stream
+        vector<xProgram> m_Programs;
+        uint32_t m_NumUnchanged = 0;
+        uint32_t m_NumParsed = 0;
+
+    public:
+        xTS_ServiceDiscovery(xTS_Demux *Demux, xTS_ContinuityMonitor *Monitor) : m_Demux(Demux), m_Monitor(Monitor) { Reset(); }
+
+        //forgets tables and counters of a previous stream, settings given to Init() stay
+        void Reset() {
+            memset(m_PATVersion, NoVersion, sizeof(m_PATVersion));
+            memset(m_StreamType, 0, sizeof(m_StreamType));
+            fill(m_StreamProgram.begin(), m_StreamProgram.end(), 0);
+            m_Programs.clear();
+            m_NumUnchanged = 0;
+            m_NumParsed = 0;
+        }
+
+        //registers the PAT section assembler
+        //SplitAccessUnits attaches splitters to H.264/HEVC assemblers, also to ones registered before the PMT arrived
+        int32_t Init(bool AutoExtract, bool ZeroCopy = false, bool DropCorrupt = false, bool ParseHeader = true,
+                     bool SplitAccessUnits = false) {
+            m_AutoExtract = AutoExtract;
+            m_ZeroCopy = ZeroCopy;
+            m_DropCorrupt = DropCorrupt;
+            m_ParseHeader = ParseHeader;
+            m_SplitAccessUnits = SplitAccessUnits;
+            return xRegisterSectionAssembler(PATPID);
+        }
+
+        void AbsorbSection(uint16_t PID, const uint8_t *Section, uint32_t Length, bool ValidCRC) override {
+            uint8_t TableId = Section[0];
+            bool IsPAT = PID == PATPID;
+            bool IsPMT = TableId == PMTTableId;
+
+            if (!ValidCRC or (IsPAT and TableId != PATTableId) or Length < 12) {
+                if (m_Monitor != nullptr and IsPAT) m_Monitor->AddPATError();
+                else if (m_Monitor != nullptr and IsPMT) m_Monitor->AddPMTError();
+                return;
+            }
+
+            //current_next_indicator
+            if ((Section[5] & 0b00000001) == 0) return;
+            uint8_t Version = (Section[5] >> 1) & 0x1F;
+
+            if (IsPAT) {
+                uint8_t SectionNumber = Section[6];
+                if (m_PATVersion[SectionNumber] == Version) {
+                    m_NumUnchanged++;
+                    return;
+                }
+                m_PATVersion[SectionNumber] = Version;
+                xParsePAT(SectionNumber, Section, Length);
+            } else if (IsPMT) {
+                //PMTs of programs the PAT does not announce on this PID are ignored
+                uint16_t ProgramNumber = (uint16_t) Section[3] << 8 | Section[4];
+                xProgram *Program = nullptr;
+                for (xProgram &Candidate : m_Programs) {
+                    if (Candidate.ProgramNumber == ProgramNumber and Candidate.PMTPID == PID) Program = &Candidate;
+                }
+                if (Program == nullptr) return;
+                if (Program->PMTVersion == Version) {
+                    m_NumUnchanged++;
+                    return;
+                }
+                Program->PMTVersion = Version;
+                xParsePMT(*Program, Section, Length);
+            }
+            m_NumParsed++;
+        }
+
+        uint8_t getStreamType(uint16_t PID) const { return m_StreamType[PID]; }
+        const vector<xProgram> &getPrograms() const { return m_Programs; }
+        bool isComplete() const {
+            if (m_Programs.empty()) return false;
+            for (const xProgram &Program : m_Programs) {
+                if (!Program.Known) return false;
+            }
+            return true;
+        }
+
+        //file extension for stream types carried in PES, nullptr for section based streams
+        static const char *getStreamExtension(uint8_t StreamType) {
+            switch (StreamType) {
+                case 0x01: case 0x02: return "m2v";
+                case 0x03: case 0x04: return "mp2";
+                case 0x0F: return "aac";
+                case 0x11: return "latm";
+                case 0x1B: return "264";
+                case 0x24: return "265";
+                case 0x81: return "ac3";
+                case 0x87: return "eac3";
+                case 0x06: case 0x10: case 0x15: case 0x80: return "es";
+                default: return nullptr;
+            }
+        }
+
+        //PID arguments ("PID:path") of discovered elementary streams
+        void getStreamArguments(vector<string> &Arguments) const {
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                const char *Extension = getStreamExtension(m_StreamType[PID]);
+                if (Extension == nullptr) continue;
+                Arguments.push_back(to_string(PID) + ":pid" + to_string(PID) + "." + Extension);
+            }
+        }
+
+        //runs discovery over the beginning of a mapped capture until all PMTs are known
+        static xTS_ServiceDiscovery *Probe(const uint8_t *Data, size_t Size, size_t MaxProbeLength = 64 << 20) {
+            xTS_Demux *Demux = new xTS_Demux;
+            xTS_ServiceDiscovery *Discovery = new xTS_ServiceDiscovery(Demux, nullptr);
+            Discovery->Init(false);
+
+            xTS_SyncScanner Scanner;
+            xTS_PacketHeader PacketHeader;
+            xTS_AdaptationField AdaptationField;
+            size_t Position = 0;
+            if (Size > MaxProbeLength) Size = MaxProbeLength;
+
+            while (Position < Size and !Discovery->isComplete()) {
+                size_t NumSkippedBytes;
+                uint32_t NumPackets = Scanner.Scan(Data + Position, Size - Position, NumSkippedBytes, true);
+                if (NumPackets == 0) {
+                    if (NumSkippedBytes == 0 and !Scanner.isLocked()) break;
+                    Position += NumSkippedBytes;
+                    continue;
+                }
+                for (uint32_t PacketIdx = 0; PacketIdx < NumPackets and !Discovery->isComplete(); PacketIdx++) {
+                    const uint8_t *Packet = Data + Position + (size_t) PacketIdx * Scanner.getPacketSize();
+                    PacketHeader.Parse(Packet);
+                    xTS_PacketHandler *Handler = Demux->getHandler(PacketHeader.getPacketIdentifier());
+                    if (Handler == nullptr) continue;
+                    AdaptationField.Reset();
+                    if (PacketHeader.hasAdaptationField()) AdaptationField.Parse(Packet, PacketHeader.getAdaptationFieldControl());
+                    Handler->Handle(Packet, &PacketHeader, &AdaptationField);
+                }
+                Position += (size_t) NumPackets * Scanner.getPacketSize();
+            }
+
+            Discovery->m_Demux = nullptr;
+            delete Demux;
+            return Discovery;
+        }
+
+        void PrintStats() const {
+            printf("PSI: Parsed=%d Unchanged=%d\n", m_NumParsed, m_NumUnchanged);
+            for (const xProgram &Program : m_Programs) {
+                printf("PSI: Program=%d PMT=%d PCR=%d Streams:", Program.ProgramNumber, Program.PMTPID, Program.PCRPID);
+                for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                    if (m_StreamType[PID] != 0 and xProgramOf(PID) == &Program) printf(" %d(0x%02x)", PID, m_StreamType[PID]);
+                }
+                printf("\n");
+            }
+        }
+
+    protected:
+        const xProgram *xProgramOf(uint16_t PID) const {
+            for (const xProgram &Program : m_Programs) {
+                if (Program.ProgramNumber == m_StreamProgram[PID]) return &Program;
+            }
+            return nullptr;
+        }
+
+        int32_t xRegisterSectionAssembler(uint16_t PID) {
+            if (m_Demux == nullptr or m_Demux->getHandler(PID) != nullptr) return -1;
+            xPSI_SectionAssembler *Assembler = new xPSI_SectionAssembler(PID, this);
+            if (m_Demux->Register(PID, Assembler) != 0) {
+                delete Assembler;
+                return -1;
+            }
+            return 0;
+        }
+
+        //a new version of a PAT section replaces the programs listed by its previous version
+        void xParsePAT(uint8_t SectionNumber, const uint8_t *Section, uint32_t Length) {
+            vector<uint16_t> Listed;
+            //program loop ends before CRC_32
+            for (uint32_t Offset = 8; Offset + 4 + 4 <= Length; Offset += 4) {
+                uint16_t ProgramNumber = (uint16_t) Section[Offset] << 8 | Section[Offset + 1];
+                uint16_t PID = ((uint16_t) (Section[Offset + 2] & 0x1F)) << 8 | Section[Offset + 3];
+                if (ProgramNumber == 0) continue;   //network PID
+                Listed.push_back(ProgramNumber);
+
+                bool Found = false;
+                for (xProgram &Program : m_Programs) {
+                    if (Program.ProgramNumber != ProgramNumber) continue;
+                    Found = true;
+                    Program.PATSection = SectionNumber;
+                    if (Program.PMTPID != PID) {
+                        Program.PMTPID = PID;
+                        Program.Known = false;
+                        Program.PMTVersion = NoVersion;
+                    }
+                }
+                if (!Found) m_Programs.push_back({ProgramNumber, PID, xTS_ContinuityMonitor::NullPID, false, SectionNumber, NoVersion});
+                xRegisterSectionAssembler(PID);
+            }
+
+            for (size_t ProgramIdx = 0; ProgramIdx < m_Programs.size(); ) {
+                const xProgram &Program = m_Programs[ProgramIdx];
+                if (Program.PATSection != SectionNumber or find(Listed.begin(), Listed.end(), Program.ProgramNumber) != Listed.end()) {
+                    ProgramIdx++;
+                    continue;
+                }
+                xForgetStreams(Program.ProgramNumber);
+                m_Programs.erase(m_Programs.begin() + ProgramIdx);
+            }
+        }
+
+        //streams of a program removed from the PAT or described by a new PMT version
+        void xForgetStreams(uint16_t ProgramNumber) {
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                if (m_StreamType[PID] == 0 or m_StreamProgram[PID] != ProgramNumber) continue;
+                m_StreamType[PID] = 0;
+                m_StreamProgram[PID] = 0;
+            }
+        }
+
+        void xParsePMT(xProgram &Program, const uint8_t *Section, uint32_t Length) {
+            uint16_t ProgramNumber = Program.ProgramNumber;
+            uint32_t ProgramInfoLength = ((uint32_t) (Section[10] & 0x0F)) << 8 | Section[11];
+            Program.PCRPID = ((uint16_t) (Section[8] & 0x1F)) << 8 | Section[9];
+            Program.Known = true;
+            xForgetStreams(ProgramNumber);
+
+            for (uint32_t Offset = 12 + ProgramInfoLength; Offset + 5 + 4 <= Length; ) {
+                uint8_t StreamType = Section[Offset];
+                uint16_t ElementaryPID = ((uint16_t) (Section[Offset + 1] & 0x1F)) << 8 | Section[Offset + 2];
+                uint32_t ESInfoLength = ((uint32_t) (Section[Offset + 3] & 0x0F)) << 8 | Section[Offset + 4];
+                m_StreamType[ElementaryPID] = StreamType;
+                m_StreamProgram[ElementaryPID] = ProgramNumber;
+                xRegisterStream(ElementaryPID, StreamType);
+                Offset += 5 + ESInfoLength;
+            }
+        }
+
+        void xRegisterStream(uint16_t PID, uint8_t StreamType) {
+            xRegisterAssembler(PID, StreamType);
+
+            xES_AccessUnitSplitter::eCodec Codec;
+            xPES_Assembler *Assembler = m_Demux != nullptr ? dynamic_cast<xPES_Assembler *>(m_Demux->getHandler(PID)) : nullptr;
+            if (!m_SplitAccessUnits or Assembler == nullptr or Assembler->hasSplitter() or !xES_AccessUnitSplitter::getCodec(StreamType, Codec)) return;
+            char OutputPath[32];
+            snprintf(OutputPath, sizeof(OutputPath), "pid%d.au", PID);
+            xES_AccessUnitSplitter *Splitter = new xES_AccessUnitSplitter;
+            if (Splitter->Init(PID, Codec, OutputPath) != 0) {
+                delete Splitter;
+                printf("cannot write access units of PID %d to %s\n", PID, OutputPath);
+                return;
+            }
+            Assembler->AttachSplitter(Splitter);
+        }
+
+        virtual void xRegisterAssembler(uint16_t PID, uint8_t StreamType) {
+            if (m_Demux != nullptr and m_Demux->getHandler(PID) != nullptr) {
+                xRetypeAssembler(PID, StreamType);
+                return;
+            }
+            const char *Extension = getStreamExtension(StreamType);
+            if (!m_AutoExtract or Extension == nullptr or m_Demux == nullptr) return;
+
+            char OutputPath[32];
+            snprintf(OutputPath, sizeof(OutputPath), "pid%d.%s", PID, Extension);
+            xPES_Assembler *Assembler = xPES_AssemblerFactory::Create(PID, OutputPath, StreamType, m_ZeroCopy, m_DropCorrupt, m_ParseHeader);
+            if (Assembler == nullptr or m_Demux->Register(PID, Assembler) != 0) {
+                delete Assembler;
+                printf("cannot extract PID %d to %s\n", PID, OutputPath);
+            }
+        }
+
+        //an assembler given with -p before the PMT was seen gets the length policy of its stream type
+        void xRetypeAssembler(uint16_t PID, uint8_t StreamType) {
+            xPES_Assembler *Assembler = dynamic_cast<xPES_Assembler *>(m_Demux->getHandler(PID));
+            if (Assembler == nullptr) return;
+            xPES_Assembler *Retyped = xPES_AssemblerFactory::Retype(Assembler, StreamType, m_ZeroCopy, m_ParseHeader);
+            if (Retyped == nullptr) return;
+            delete m_Demux->Detach(PID);
+            m_Demux->Register(PID, Retyped);
+        }
+};
+
+//fixed width little endian record written per packet in binary logging mode
+struct __attribute__((packed)) xTS_PacketRecord {
+    uint64_t PacketId;
+    uint64_t PCR;                   //27MHz, UINT64_MAX if absent
+    uint64_t PTS;                   //90kHz, UINT64_MAX if absent
+    uint64_t DTS;                   //90kHz, UINT64_MAX if absent
+    int32_t FinishedLength;         //length of PES finished by this packet, -1 if none
+    uint16_t PID;
+    uint8_t Header;                 //TEI | PUSI | TP | TSC(2b) | AFC(2b) | 0
+    uint8_t ContinuityCounter;
+    uint8_t AdaptationFlags;        //DI | RAI | PCR | 0...
+    uint8_t AdaptationLength;
+    int16_t Result;                 //handler result, 0 if no handler
+    uint32_t Reserved;
+};
+static_assert(sizeof(xTS_PacketRecord) == 48, "packet record must stay 48 bytes");
+
+//per packet metadata output: human text, nothing, binary records, NDJSON or CSV
+class xTS_Logger {
+    public:
+        enum class eMode : int32_t {
+            Off,
+            Text,
+            Binary,
+            NDJSON,
+            CSV,
+        };
+
+        static constexpr uint32_t BufferLength = 1 << 20;
+        static constexpr uint32_t MaxRecordLength = 512;
+
+    protected:
+        eMode m_Mode = eMode::Text;
+        int m_FileDescriptor = STDOUT_FILENO;
+
+        static thread_local char s_Buffer[BufferLength];
+        static thread_local uint32_t s_Size;
+
+    public:
+        ~xTS_Logger() { Flush(); }
+
+        static int32_t ParseMode(const char *Name, eMode &Mode) {
+            if (strcmp(Name, "off") == 0) Mode = eMode::Off;
+            else if (strcmp(Name, "text") == 0) Mode = eMode::Text;
+            else if (strcmp(Name, "bin") == 0) Mode = eMode::Binary;
+            else if (strcmp(Name, "ndjson") == 0) Mode = eMode::NDJSON;
+            else if (strcmp(Name, "csv") == 0) Mode = eMode::CSV;
+            else return -1;
+            return 0;
+        }
+
+        //machine readable modes keep stdout for records and move diagnostics (printf) to stderr
+        void Init(eMode Mode) {
+            m_Mode = Mode;
+            if (m_Mode != eMode::Text and m_Mode != eMode::Off) {
+                fflush(stdout);
+                m_FileDescriptor = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+            }
+            if (m_Mode == eMode::CSV) {
+                xAppend("id,pid,tei,pusi,tp,tsc,afc,cc,afl,di,rai,pcr,result,pts,dts,finished\n");
+            }
+        }
+
+        eMode getMode() const { return m_Mode; }
+
+        void Packet(uint64_t PacketId, const xTS_PacketHeader *Header, const xTS_AdaptationField *AdaptationField,
+                    const xTS_PacketHandler *Handler, int32_t Result) {
+            switch (m_Mode) {
+                case eMode::Off:
+                    return;
+                case eMode::Text:
+                    printf("%010lu ", PacketId);
+                    Header->Print();
+                    if (Header->hasAdaptationField()) AdaptationField->Print();
+                    if (Handler != nullptr) Handler->PrintResult(Result);
+                    printf("\n");
+                    return;
+                default:
+                    break;
+            }
+
+            if (s_Size + MaxRecordLength > BufferLength) Flush();
+            const xPES_PacketHeader *PESHeader = Handler != nullptr ? Handler->getStartedPESHeader(Result) : nullptr;
+            int32_t FinishedLength = Handler != nullptr ? Handler->getFinishedLength(Result) : -1;
+            bool HasPCR = Header->hasAdaptationField() and AdaptationField->hasProgramClockReference();
+            uint32_t AdaptationLength = Header->hasAdaptationField() ? AdaptationField->getNumBytes() : 0;
+
+            if (m_Mode == eMode::Binary) {
+                xTS_PacketRecord Record;
+                Record.PacketId = PacketId;
+                Record.PCR = HasPCR ? AdaptationField->getProgramClockReference() : UINT64_MAX;
+                Record.PTS = PESHeader != nullptr and PESHeader->hasPTS() ? PESHeader->getPTS() : UINT64_MAX;
+                Record.DTS = PESHeader != nullptr and PESHeader->hasDTS() ? PESHeader->getDTS() : UINT64_MAX;
+                Record.FinishedLength = FinishedLength;
+                Record.PID = Header->getPacketIdentifier();
+                Record.Header = Header->isTransportErrorIndicator() << 7 | Header->isPayloadUnitStartIndicator() << 6 |
+                                Header->isTransportPriority() << 5 | (Header->getTransportScramblingControl() & 3) << 3 |
+                                Header->getAdaptationFieldControl() << 1;
+                Record.ContinuityCounter = Header->getContinuityCounter();
+                Record.AdaptationFlags = Header->hasAdaptationField() ?
+                                         AdaptationField->isDiscontinuityIndicator() << 7 | AdaptationField->isRandomAccessIndicator() << 6 |
+                                         HasPCR << 5 : 0;
+                Record.AdaptationLength = AdaptationLength;
+                Record.Result = Result;
+                Record.Reserved = 0;
+                memcpy(s_Buffer + s_Size, &Record, sizeof(Record));
+                s_Size += sizeof(Record);
+                return;
+            }
+
+            bool JSON = m_Mode == eMode::NDJSON;
+            xField(JSON, "{\"id\":", PacketId, true);
+            xField(JSON, ",\"pid\":", Header->getPacketIdentifier());
+            xField(JSON, ",\"tei\":", Header->isTransportErrorIndicator());
+            xField(JSON, ",\"pusi\":", Header->isPayloadUnitStartIndicator());
+            xField(JSON, ",\"tp\":", Header->isTransportPriority());
+            xField(JSON, ",\"tsc\":", Header->getTransportScramblingControl());
+            xField(JSON, ",\"afc\":", Header->getAdaptationFieldControl());
+            xField(JSON, ",\"cc\":", Header->getContinuityCounter());
+            xField(JSON, ",\"afl\":", AdaptationLength);
+            xField(JSON, ",\"di\":", Header->hasAdaptationField() and AdaptationField->isDiscontinuityIndicator());
+            xField(JSON, ",\"rai\":", Header->hasAdaptationField() and AdaptationField->isRandomAccessIndicator());
+            xOptionalField(JSON, ",\"pcr\":", HasPCR, HasPCR ? AdaptationField->getProgramClockReference() : 0);
+            xField(JSON, ",\"result\":", Handler != nullptr ? Result : 0);
+            xOptionalField(JSON, ",\"pts\":", PESHeader != nullptr and PESHeader->hasPTS(), PESHeader != nullptr ? PESHeader->getPTS() : 0);
+            xOptionalField(JSON, ",\"dts\":", PESHeader != nullptr and PESHeader->hasDTS(), PESHeader != nullptr ? PESHeader->getDTS() : 0);
+            xOptionalField(JSON, ",\"finished\":", FinishedLength >= 0, FinishedLength);
+            xAppend(JSON ? "}\n" : "\n");
+        }
+
+        void Flush() {
+            uint32_t Offset = 0;
+            while (Offset < s_Size) {
+                ssize_t NumWritten = write(m_FileDescriptor, s_Buffer + Offset, s_Size - Offset);
+                if (NumWritten < 0 and errno == EINTR) continue;
+                if (NumWritten <= 0) break;
+                Offset += NumWritten;
+            }
+            s_Size = 0;
+        }
+
+    protected:
+        void xAppend(const char *Text) {
+            size_t Length = strlen(Text);
+            memcpy(s_Buffer + s_Size, Text, Length);
+            s_Size += Length;
+        }
+
+        //hand rolled formatting, two digits per step
+        void xAppendUInt(uint64_t Value) {
+            static const char Digits[] =
+                    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                    "8081828384858687888990919293949596979899";
+            char Text[20];
+            uint32_t Position = sizeof(Text);
+            while (Value >= 100) {
+                uint32_t Pair = (Value % 100) * 2;
+                Value /= 100;
+                Text[--Position] = Digits[Pair + 1];
+                Text[--Position] = Digits[Pair];
+            }
+            if (Value >= 10) {
+                Text[--Position] = Digits[Value * 2 + 1];
+                Text[--Position] = Digits[Value * 2];
+            } else {
+                Text[--Position] = '0' + Value;
+            }
+            memcpy(s_Buffer + s_Size, Text + Position, sizeof(Text) - Position);
+            s_Size += sizeof(Text) - Position;
+        }
+
+        void xAppendInt(int64_t Value) {
+            if (Value < 0) {
+                s_Buffer[s_Size++] = '-';
+                xAppendUInt(-(uint64_t) Value);
+            } else {
+                xAppendUInt(Value);
+            }
+        }
+
+        //JSON gets the key, CSV only a separator (none before the first column)
+        void xField(bool JSON, const char *Key, int64_t Value, bool First = false) {
+            if (JSON) xAppend(Key);
+            else if (!First) s_Buffer[s_Size++] = ',';
+            xAppendInt(Value);
+        }
+
+        void xOptionalField(bool JSON, const char *Key, bool Present, int64_t Value) {
+            if (!Present) {
+                if (!JSON) s_Buffer[s_Size++] = ',';
+                return;
+            }
+            xField(JSON, Key, Value);
+        }
+};
+
+thread_local char xTS_Logger::s_Buffer[xTS_Logger::BufferLength];
+thread_local uint32_t xTS_Logger::s_Size = 0;
+
+//sidecar random access index, little endian, mappable: header, stream directory, per stream checkpoints and entries
+//entry: varint(offset delta << 3 | RAI << 2 | DTS << 1 | PTS) [zigzag varint PTS delta] [varint PTS - DTS]
+struct __attribute__((packed)) xTS_IndexHeader {
+    char Magic[4];                  //"TSIX"
+    uint32_t Version;
+    uint32_t PacketSize;
+    uint32_t NumStreams;
+    uint64_t InputSize;             //bytes of indexed capture
+    uint32_t CheckpointInterval;    //entries between checkpoints
+    uint32_t Reserved;
+};
+static_assert(sizeof(xTS_IndexHeader) == 32, "index header must stay 32 bytes");
+
+struct __attribute__((packed)) xTS_IndexStream {
+    uint16_t PID;
+    uint8_t StreamId;
+    uint8_t Reserved;
+    uint32_t NumEntries;
+    uint32_t NumCheckpoints;
+    uint32_t NumKeyframes;
+    uint64_t FirstPTS;              //90kHz, UINT64_MAX if stream carries none
+    uint64_t CheckpointsOffset;     //from beginning of index file
+    uint64_t EntriesOffset;
+    uint64_t EntriesLength;
+};
+static_assert(sizeof(xTS_IndexStream) == 48, "index stream must stay 48 bytes");
+
+//decoder state before entry EntryIdx, allows decoding to start in the middle
+struct __attribute__((packed)) xTS_IndexCheckpoint {
+    uint64_t ByteOffset;            //of previous entry
+    uint64_t PTS;                   //last PTS before the entry
+    uint64_t KeyframeOffset;        //last random access point before the entry, UINT64_MAX if none
+    uint64_t KeyframePTS;
+    uint32_t EntryIdx;
+    uint32_t EncodedOffset;         //into entries
+};
+static_assert(sizeof(xTS_IndexCheckpoint) == 40, "index checkpoint must stay 40 bytes");
+
+class xTS_IndexFormat {
+    public:
+        static constexpr uint32_t Version = 1;
+        static constexpr uint32_t CheckpointInterval = 256;
+        static constexpr uint64_t PTSModulus = 1ull << 33;
+        static constexpr uint64_t None = UINT64_MAX;
+
+        enum eEntryFlags : uint8_t {
+            eEntry_PTS = 0b001,
+            eEntry_DTS = 0b010,
+            eEntry_RandomAccess = 0b100,
+        };
+
+        static void PutVarint(vector<uint8_t> &Output, uint64_t Value) {
+            while (Value >= 0x80) {
+                Output.push_back((uint8_t) Value | 0x80);
+                Value >>= 7;
+            }
+            Output.push_back((uint8_t) Value);
+        }
+
+        static uint64_t GetVarint(const uint8_t *&Input) {
+            uint64_t Value = 0;
+            for (uint32_t Shift = 0; ; Shift += 7) {
+                uint8_t Byte = *Input++;
+                Value |= (uint64_t) (Byte & 0x7F) << Shift;
+                if ((Byte & 0x80) == 0) return Value;
+            }
+        }
+
+        //signed distance between 33 bit timestamps
+        static int64_t PTSDelta(uint64_t To, uint64_t From) {
+            int64_t Delta = (int64_t) ((To - From) & (PTSModulus - 1));
+            return Delta >= (int64_t) (PTSModulus / 2) ? Delta - (int64_t) PTSModulus : Delta;
+        }
+        static uint64_t ZigZag(int64_t Value) { return ((uint64_t) Value << 1) ^ (uint64_t) (Value >> 63); }
+        static int64_t UnZigZag(uint64_t Value) { return (int64_t) (Value >> 1) ^ -(int64_t) (Value & 1); }
+};
+
+//collects PES starts of all PIDs in one pass and writes the index at the end
+class xTS_IndexWriter {
+    protected:
+        struct xStream {
+            xTS_IndexStream Directory;
+            vector<uint8_t> Entries;
+            vector<xTS_IndexCheckpoint> Checkpoints;
+            uint64_t LastOffset;
+            uint64_t LastPTS;
+            uint64_t KeyframeOffset;
+            uint64_t KeyframePTS;
+        };
+
+        int16_t m_StreamOf[xTS_Demux::NumPIDs];
+        vector<xStream *> m_Streams;
+        xPES_PacketHeader m_PESHeader;
+
+    public:
+        xTS_IndexWriter() { memset(m_StreamOf, -1, sizeof(m_StreamOf)); }
+        ~xTS_IndexWriter() {
+            for (xStream *Stream : m_Streams) delete Stream;
+        }
+
+        //ByteOffset of the packet in the capture
+        void AbsorbPacket(const uint8_t *Packet, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField,
+                          uint64_t ByteOffset) {
+            if (!PacketHeader->isPayloadUnitStartIndicator() or !PacketHeader->hasPayload()) return;
+            uint32_t Offset = xTS::TS_HeaderLength + AdaptationField->getNumBytes();
+            //PES start code, sections start with pointer_field and table_id instead
+            if (Offset + xTS::PES_HeaderLength > xTS::TS_PacketLength or Packet[Offset] != 0 or Packet[Offset + 1] != 0 or
+                Packet[Offset + 2] != 1) return;
+
+            uint8_t Flags = AdaptationField->isRandomAccessIndicator() ? xTS_IndexFormat::eEntry_RandomAccess : 0;
+            uint64_t PTS = 0, DTS = 0;
+            //optional header with PTS and DTS fits the first packet
+            if (Offset + 19 <= xTS::TS_PacketLength) {
+                m_PESHeader.Reset();
+                m_PESHeader.Parse(Packet, Offset);
+                if (m_PESHeader.hasPTS()) {
+                    Flags |= xTS_IndexFormat::eEntry_PTS;
+                    PTS = m_PESHeader.getPTS();
+                    if (m_PESHeader.hasDTS()) {
+                        Flags |= xTS_IndexFormat::eEntry_DTS;
+                        DTS = m_PESHeader.getDTS();
+                    }
+                }
+            }
+
+            uint16_t PID = PacketHeader->getPacketIdentifier();
+            xStream &Stream = xGetStream(PID, Packet[Offset + 3]);
+            if (Stream.Directory.NumEntries % xTS_IndexFormat::CheckpointInterval == 0) {
+                Stream.Checkpoints.push_back({Stream.LastOffset, Stream.LastPTS, Stream.KeyframeOffset, Stream.KeyframePTS,
+                                              Stream.Directory.NumEntries, (uint32_t) Stream.Entries.size()});
+            }
+
+            xTS_IndexFormat::PutVarint(Stream.Entries, (ByteOffset - Stream.LastOffset) << 3 | Flags);
+            if (Flags & xTS_IndexFormat::eEntry_PTS) {
+                xTS_IndexFormat::PutVarint(Stream.Entries, xTS_IndexFormat::ZigZag(xTS_IndexFormat::PTSDelta(PTS, Stream.LastPTS)));
+                if (Flags & xTS_IndexFormat::eEntry_DTS) {
+                    xTS_IndexFormat::PutVarint(Stream.Entries, (PTS - DTS) & (xTS_IndexFormat::PTSModulus - 1));
+                }
+                if (Stream.Directory.FirstPTS == xTS_IndexFormat::None) Stream.Directory.FirstPTS = PTS;
+                Stream.LastPTS = PTS;
+            }
+            if (Flags & xTS_IndexFormat::eEntry_RandomAccess) {
+                Stream.KeyframeOffset = ByteOffset;
+                Stream.KeyframePTS = Stream.LastPTS;
+                Stream.Directory.NumKeyframes++;
+            }
+            Stream.LastOffset = ByteOffset;
+            Stream.Directory.NumEntries++;
+        }
+
+        int32_t Write(const char *Path, uint32_t PacketSize, uint64_t InputSize) {
+            FILE *File = fopen(Path, "wb");
+            if (File == nullptr) return -1;
+
+            xTS_IndexHeader Header = {{'T', 'S', 'I', 'X'}, xTS_IndexFormat::Version, PacketSize, (uint32_t) m_Streams.size(),
+                                      InputSize, xTS_IndexFormat::CheckpointInterval, 0};
+            uint64_t Offset = sizeof(Header) + m_Streams.size() * sizeof(xTS_IndexStream);
+            for (xStream *Stream : m_Streams) {
+                Stream->Directory.NumCheckpoints = Stream->Checkpoints.size();
+                Stream->Directory.CheckpointsOffset = Offset;
+                Offset += Stream->Checkpoints.size() * sizeof(xTS_IndexCheckpoint);
+                Stream->Directory.EntriesOffset = Offset;
+                Stream->Directory.EntriesLength = Stream->Entries.size();
+                Offset += Stream->Entries.size();
+            }
+
+            bool Failed = fwrite(&Header, sizeof(Header), 1, File) != 1;
+            for (xStream *Stream : m_Streams) {
+                Failed |= fwrite(&Stream->Directory, sizeof(xTS_IndexStream), 1, File) != 1;
+            }
+            for (xStream *Stream : m_Streams) {
+                Failed |= fwrite(Stream->Checkpoints.data(), sizeof(xTS_IndexCheckpoint), Stream->Checkpoints.size(), File) != Stream->Checkpoints.size();
+                Failed |= fwrite(Stream->Entries.data(), 1, Stream->Entries.size(), File) != Stream->Entries.size();
+            }
+            Failed |= fclose(File) != 0;
+            return Failed ? -1 : 0;
+        }
+
+        void PrintStats() const {
+            for (const xStream *Stream : m_Streams) {
+                printf("INDEX: PID=%4d Entries=%d Keyframes=%d Bytes=%lu\n", Stream->Directory.PID, Stream->Directory.NumEntries,
+                       Stream->Directory.NumKeyframes, Stream->Entries.size() + Stream->Checkpoints.size() * sizeof(xTS_IndexCheckpoint));
+            }
+        }
+
+    protected:
+        xStream &xGetStream(uint16_t PID, uint8_t StreamId) {
+            if (m_StreamOf[PID] < 0) {
+                xStream *Stream = new xStream();
+                Stream->Directory.PID = PID;
+                Stream->Directory.StreamId = StreamId;
+                Stream->Directory.FirstPTS = xTS_IndexFormat::None;
+                Stream->KeyframeOffset = xTS_IndexFormat::None;
+                m_StreamOf[PID] = m_Streams.size();
+                m_Streams.push_back(Stream);
+            }
+            return *m_Streams[m_StreamOf[PID]];
+        }
+};
+
+//mapped index: finds random access points around a presentation time
+class xTS_Index {
+    protected:
+        const uint8_t *m_Data = nullptr;
+        size_t m_Size = 0;
+        const xTS_IndexHeader *m_Header = nullptr;
+        const xTS_IndexStream *m_Streams = nullptr;
+
+    public:
+        ~xTS_Index() { Close(); }
+
+        //InputSize of the capture the index must describe, 0 skips the check
+        int32_t Open(const char *Path, uint64_t InputSize = 0) {
+            int FileDescriptor = open(Path, O_RDONLY);
+            if (FileDescriptor < 0) return -1;
+            struct stat Stat;
+            if (fstat(FileDescriptor, &Stat) != 0 or (size_t) Stat.st_size < sizeof(xTS_IndexHeader)) {
+                close(FileDescriptor);
+                return -1;
+            }
+            void *Data = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+            close(FileDescriptor);
+            if (Data == MAP_FAILED) return -1;
+            m_Data = (const uint8_t *) Data;
+            m_Size = Stat.st_size;
+
+            m_Header = (const xTS_IndexHeader *) m_Data;
+            m_Streams = (const xTS_IndexStream *) (m_Data + sizeof(xTS_IndexHeader));
+            bool Valid = memcmp(m_Header->Magic, "TSIX", 4) == 0 and m_Header->Version == xTS_IndexFormat::Version and
+                         (InputSize == 0 or m_Header->InputSize == InputSize) and
+                         sizeof(xTS_IndexHeader) + (uint64_t) m_Header->NumStreams * sizeof(xTS_IndexStream) <= m_Size;
+            for (uint32_t StreamIdx = 0; Valid and StreamIdx < m_Header->NumStreams; StreamIdx++) {
+                const xTS_IndexStream &Stream = m_Streams[StreamIdx];
+                Valid = Stream.CheckpointsOffset + (uint64_t) Stream.NumCheckpoints * sizeof(xTS_IndexCheckpoint) <= m_Size and
+                        Stream.EntriesOffset + Stream.EntriesLength <= m_Size;
+            }
+            if (!Valid) {
+                Close();
+                return -1;
+            }
+            return 0;
+        }
+
+        void Close() {
+            if (m_Data != nullptr) munmap((void *) m_Data, m_Size);
+            m_Data = nullptr;
+            m_Size = 0;
+        }
+
+        uint32_t getNumStreams() const { return m_Header->NumStreams; }
+        const xTS_IndexStream *getStream(uint32_t StreamIdx) const { return &m_Streams[StreamIdx]; }
+
+        //stream to seek on: given PID, or first one with random access points (video)
+        const xTS_IndexStream *FindStream(int32_t PID = -1) const {
+            for (uint32_t StreamIdx = 0; StreamIdx < m_Header->NumStreams; StreamIdx++) {
+                const xTS_IndexStream &Stream = m_Streams[StreamIdx];
+                if (PID >= 0 ? Stream.PID == PID : Stream.NumKeyframes != 0 and Stream.FirstPTS != xTS_IndexFormat::None) return &Stream;
+            }
+            return nullptr;
+        }
+
+        //random access points around Time (90kHz, relative to stream's first PTS):
+        //Before - last one presented at or before Time (0 if none), After - first one presented later (input size if none)
+        void Seek(const xTS_IndexStream *Stream, uint64_t Time, uint64_t &Before, uint64_t &After) const {
+            const xTS_IndexCheckpoint *Checkpoints = (const xTS_IndexCheckpoint *) (m_Data + Stream->CheckpointsOffset);
+            Before = 0;
+            After = m_Header->InputSize;
+            if (Stream->NumCheckpoints == 0) return;
+
+            //keyframe times grow with decode order, checkpoints are bisected on the last keyframe they carry
+            uint32_t Low = 0, High = Stream->NumCheckpoints;
+            while (High - Low > 1) {
+                uint32_t Middle = (Low + High) / 2;
+                const xTS_IndexCheckpoint &Checkpoint = Checkpoints[Middle];
+                if (Checkpoint.KeyframeOffset != xTS_IndexFormat::None and xElapsed(Stream, Checkpoint.KeyframePTS) > (int64_t) Time) High = Middle;
+                else Low = Middle;
+            }
+
+            const xTS_IndexCheckpoint &Checkpoint = Checkpoints[Low];
+            if (Checkpoint.KeyframeOffset != xTS_IndexFormat::None) Before = Checkpoint.KeyframeOffset;
+            const uint8_t *Input = m_Data + Stream->EntriesOffset + Checkpoint.EncodedOffset;
+            const uint8_t *End = m_Data + Stream->EntriesOffset + Stream->EntriesLength;
+            uint64_t ByteOffset = Checkpoint.ByteOffset;
+            uint64_t PTS = Checkpoint.PTS;
+            while (Input < End) {
+                uint64_t Word = xTS_IndexFormat::GetVarint(Input);
+                ByteOffset += Word >> 3;
+                if (Word & xTS_IndexFormat::eEntry_PTS) {
+                    PTS = (PTS + xTS_IndexFormat::UnZigZag(xTS_IndexFormat::GetVarint(Input))) & (xTS_IndexFormat::PTSModulus - 1);
+                    if (Word & xTS_IndexFormat::eEntry_DTS) xTS_IndexFormat::GetVarint(Input);
+                }
+                if ((Word & xTS_IndexFormat::eEntry_RandomAccess) == 0) continue;
+                if (xElapsed(Stream, PTS) > (int64_t) Time) {
+                    After = ByteOffset;
+                    return;
+                }
+                Before = ByteOffset;
+            }
+        }
+
+    protected:
+        static int64_t xElapsed(const xTS_IndexStream *Stream, uint64_t PTS) { return xTS_IndexFormat::PTSDelta(PTS, Stream->FirstPTS); }
+};
+
+class xTS_Input {
+    protected:
+        uint64_t m_NumConsumedBytes = 0;
+
+    public:
+        virtual ~xTS_Input() {};
+
+        virtual int32_t Open(const char *Path) = 0;
+        virtual void Close() = 0;
+
+        //returns span of at least MinBytes unconsumed bytes or nullptr when input is exhausted
+        virtual const uint8_t *Acquire(size_t &NumBytes, size_t MinBytes = xTS::TS_PacketLength) = 0;
+        //marks NumBytes from the beginning of last span as consumed, the rest is returned again by next Acquire
+        virtual void Release(size_t NumBytes) { m_NumConsumedBytes += NumBytes; }
+        //spans stay valid until Close() (no need to copy packets out of them)
+        virtual bool isPersistent() const { return false; }
+        //arrival time [ns, CLOCK_REALTIME] of the datagram carrying given stream byte, -1 when unknown
+        virtual int64_t getArrivalTime(uint64_t ByteOffset) const { return -1; }
+        virtual void PrintStats() const {};
+        //Consumer is told once per quiet period when no data arrived for Timeout ms, pipes and stdin only
+        virtual void SetIdleConsumer(xTS_IdleConsumer *Consumer, uint32_t Timeout) {};
+        //live inputs end once *StopFlag is set (by a signal handler), false when the input does not watch it
+        virtual bool SetStopFlag(const volatile sig_atomic_t *StopFlag) { return false; }
+
+        uint64_t getNumConsumedBytes() const { return m_NumConsumedBytes; }
+
+        static xTS_Input *Create(const char *Path);
+};
+
+class xTS_MmapInput : public xTS_Input {
+    protected:
+        int m_FileDescriptor = -1;
+        const uint8_t *m_Data = nullptr;
+        size_t m_Size = 0;
+        size_t m_Cursor = 0;
+        size_t m_Limit = 0;
+
+    public:
+        ~xTS_MmapInput() override { Close(); }
+
+        int32_t Open(const char *Path) override {
+            m_FileDescriptor = open(Path, O_RDONLY);
+            if (m_FileDescriptor < 0) return -1;
+
+            struct stat Stat;
+            if (fstat(m_FileDescriptor, &Stat) != 0 or !S_ISREG(Stat.st_mode) or Stat.st_size == 0) {
+                Close();
+                return -1;
+            }
+
+            void *Data = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, m_FileDescriptor, 0);
+            if (Data == MAP_FAILED) {
+                Close();
+                return -1;
+            }
+            madvise(Data, Stat.st_size, MADV_SEQUENTIAL);
+
+            m_Data = (const uint8_t *) Data;
+            m_Size = Stat.st_size;
+            m_Cursor = 0;
+            m_Limit = m_Size;
+            return 0;
+        }
+
+        void Close() override {
+            if (m_Data != nullptr) munmap((void *) m_Data, m_Size);
+            if (m_FileDescriptor >= 0) close(m_FileDescriptor);
+            m_Data = nullptr;
+            m_Size = 0;
+            m_Cursor = 0;
+            m_Limit = 0;
+            m_FileDescriptor = -1;
+        }
+
+        const uint8_t *Acquire(size_t &NumBytes, size_t MinBytes = xTS::TS_PacketLength) override {
+            size_t Remaining = m_Limit - m_Cursor;
+            if (Remaining < MinBytes or Remaining == 0) return nullptr;
+            NumBytes = Remaining < xTS::InputBlockLength ? Remaining : xTS::InputBlockLength;
+            if (NumBytes < MinBytes) NumBytes = MinBytes;
+            return m_Data + m_Cursor;
+        }
+
+        void Release(size_t NumBytes) override {
+            m_Cursor += NumBytes;
+            xTS_Input::Release(NumBytes);
+        }
+
+        bool isPersistent() const override { return true; }
+
+    public:
+        const uint8_t *getData() const { return m_Data; }
+        size_t getSize() const { return m_Size; }
+
+        //limits reading to [Begin, End), offsets reported by getNumConsumedBytes() stay absolute
+        void Restrict(size_t Begin, size_t End) {
+            if (End > m_Size) End = m_Size;
+            if (Begin > End) Begin = End;
+            m_Cursor = Begin;
+            m_Limit = End;
+            m_NumConsumedBytes = Begin;
+        }
+};
+
+class xTS_BlockInput : public xTS_Input {
+    protected:
+        int m_FileDescriptor = -1;
+        bool m_OwnsDescriptor = false;
+        bool m_EndOfInput = false;
+        uint8_t *m_Buffer = nullptr;
+        size_t m_Capacity = 0;
+        size_t m_Begin = 0;
+        size_t m_End = 0;
+        xTS_IdleConsumer *m_IdleConsumer = nullptr;
+        uint32_t m_IdleTimeout = 0;     //ms
+        bool m_Idle = false;            //consumer told, waiting without timeout
+        uint32_t m_NumIdles = 0;
+
+    public:
+        ~xTS_BlockInput() override { Close(); }
+
+        //"-" reads standard input
+        int32_t Open(const char *Path) override {
+            if (strcmp(Path, "-") == 0) {
+                m_FileDescriptor = STDIN_FILENO;
+                m_OwnsDescriptor = false;
+            } else {
+                m_FileDescriptor = open(Path, O_RDONLY);
+                if (m_FileDescriptor < 0) return -1;
+                m_OwnsDescriptor = true;
+                posix_fadvise(m_FileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+
+            //carried partial packet never exceeds one alignment unit
+            m_Capacity = xTS::InputBlockLength + xTS::InputBlockAlignment;
+            m_Buffer = (uint8_t *) aligned_alloc(xTS::InputBlockAlignment, m_Capacity);
+            if (m_Buffer == nullptr) {
+                Close();
+                return -1;
+            }
+            m_Begin = m_End = 0;
+            m_EndOfInput = false;
+            return 0;
+        }
+
+        void Close() override {
+            if (m_OwnsDescriptor and m_FileDescriptor >= 0) close(m_FileDescriptor);
+            free(m_Buffer);
+            m_Buffer = nullptr;
+            m_FileDescriptor = -1;
+            m_OwnsDescriptor = false;
+        }
+
+        const uint8_t *Acquire(size_t &NumBytes, size_t MinBytes = xTS::TS_PacketLength) override {
+            if (m_End - m_Begin < MinBytes and !m_EndOfInput) {
+                xFill(MinBytes);
+            }
+            if (m_End - m_Begin < MinBytes or m_End == m_Begin) return nullptr;
+            NumBytes = m_End - m_Begin;
+            return m_Buffer + m_Begin;
+        }
+
+        void Release(size_t NumBytes) override {
+            m_Begin += NumBytes;
+            xTS_Input::Release(NumBytes);
+        }
+
+        void SetIdleConsumer(xTS_IdleConsumer *Consumer, uint32_t Timeout) override {
+            m_IdleConsumer = Consumer;
+            m_IdleTimeout = Timeout;
+        }
+
+        void PrintStats() const override {
+            if (m_IdleConsumer != nullptr) printf("INPUT: IdleFlushes=%d\n", m_NumIdles);
+        }
+
+    protected:
+        //blocks until the descriptor is readable, a quiet period longer than the timeout is reported once
+        void xWaitReadable() {
+            pollfd Poll = {m_FileDescriptor, POLLIN, 0};
+            while (true) {
+                int Result = poll(&Poll, 1, m_Idle ? -1 : (int) m_IdleTimeout);
+                if (Result > 0 or (Result < 0 and errno != EINTR)) break;
+                if (Result == 0) {
+                    m_IdleConsumer->AbsorbIdle();
+                    m_Idle = true;
+                    m_NumIdles++;
+                }
+            }
+            m_Idle = false;
+        }
+
+        void xFill(size_t MinBytes) {
+            //move unconsumed tail (partial packet) to the front and read behind it
+            if (m_Begin != 0) {
+                memmove(m_Buffer, m_Buffer + m_Begin, m_End - m_Begin);
+                m_End -= m_Begin;
+                m_Begin = 0;
+            }
+            //regular files fill the block in one read, pipes return as soon as MinBytes arrived
+            while (m_End < MinBytes or m_End < xTS::TS_PacketLength) {
+                if (m_IdleConsumer != nullptr) xWaitReadable();
+                ssize_t NumRead = read(m_FileDescriptor, m_Buffer + m_End, m_Capacity - m_End);
+                if (NumRead < 0 and errno == EINTR) continue;
+                if (NumRead <= 0) {
+                    m_EndOfInput = true;
+                    break;
+                }
+                m_End += NumRead;
+            }
+        }
+};
+
+//live TS over UDP or RTP (RFC 2250), IPv4 unicast or multicast
+//  udp://[group]:port[?ifaddr=a.b.c.d&rcvbuf=bytes&timeout=ms&timestamps=0]
+//  rtp://[group]:port[?...]
+class xTS_UdpInput : public xTS_Input {
+    public:
+        static constexpr uint32_t NumMessages = 64;                         //datagrams per recvmmsg
+        static constexpr uint32_t MaxDatagramLength = 9216;                 //jumbo frames
+        static constexpr uint32_t DefaultSlotLength = 7 * xTS::TS_PacketLength;
+        static constexpr uint32_t RTP_HeaderLength = 12;
+        static constexpr uint32_t ControlLength = 64;
+        static constexpr int DefaultReceiveBufferLength = 16 << 20;
+
+        struct xArrival {
+            uint64_t ByteOffset;    //stream offset of first payload byte
+            int64_t Time;           //ns
+        };
+
+    protected:
+        int m_Socket = -1;
+        bool m_RTP = false;
+        bool m_Timestamps = true;
+        bool m_EndOfInput = false;
+
+        //unconsumed carry at the front, datagram payload slots behind it
+        uint8_t *m_Buffer = nullptr;
+        size_t m_Capacity = 0;
+        size_t m_Begin = 0;
+        size_t m_End = 0;
+        uint32_t m_SlotLength = DefaultSlotLength;
+
+        mmsghdr m_Messages[NumMessages];
+        iovec m_Vectors[NumMessages][3];                    //RTP header, payload slot, overflow
+        uint8_t m_Headers[NumMessages][RTP_HeaderLength];
+        uint8_t *m_Overflow = nullptr;
+        uint8_t m_Control[NumMessages][ControlLength];
+        vector<uint8_t> m_Spill;
+
+        vector<xArrival> m_Arrivals;
+
+        uint16_t m_ExpectedSequence = 0;
+        bool m_SequenceKnown = false;
+
+        uint64_t m_NumDatagrams = 0;
+        uint64_t m_NumBatches = 0;
+        uint64_t m_NumCompactedBatches = 0;
+        uint64_t m_NumTruncated = 0;
+        uint64_t m_NumInvalidRTP = 0;
+        uint64_t m_NumRTPLost = 0;
+        uint64_t m_NumRTPGaps = 0;
+        uint64_t m_NumRTPReordered = 0;
+        uint32_t m_NumKernelDrops = 0;
+
+        const volatile sig_atomic_t *m_StopFlag = nullptr;
+
+    public:
+        ~xTS_UdpInput() override { Close(); }
+
+        static bool isURL(const char *Path) { return strncmp(Path, "udp://", 6) == 0 or strncmp(Path, "rtp://", 6) == 0; }
+
+        int32_t Open(const char *Path) override {
+            if (!isURL(Path)) return -1;
+            m_RTP = strncmp(Path, "rtp://", 6) == 0;
+
+            //[group]:port?options
+            char Address[64] = "";
+            char Options[256] = "";
+            const char *Authority = Path + 6;
+            const char *Colon = strrchr(Authority, ':');
+            if (Colon == nullptr or (size_t) (Colon - Authority) >= sizeof(Address)) return -1;
+            memcpy(Address, Authority, Colon - Authority);
+            Address[Colon - Authority] = '\0';
+            char *End;
+            long Port = strtol(Colon + 1, &End, 10);
+            if (End == Colon + 1 or Port <= 0 or Port > 65535 or (*End != '\0' and *End != '?')) return -1;
+            if (*End == '?') snprintf(Options, sizeof(Options), "%s", End + 1);
+
+            in_addr Interface = {htonl(INADDR_ANY)};
+            int ReceiveBufferLength = DefaultReceiveBufferLength;
+            int TimeoutMs = 0;
+            for (char *Saveptr, *Option = strtok_r(Options, "&", &Saveptr); Option != nullptr; Option = strtok_r(nullptr, "&", &Saveptr)) {
+                char *Value = strchr(Option, '=');
+                if (Value == nullptr) return -1;
+                *Value++ = '\0';
+                if (strcmp(Option, "ifaddr") == 0) {
+                    if (inet_pton(AF_INET, Value, &Interface) != 1) return -1;
+                } else if (strcmp(Option, "rcvbuf") == 0) {
+                    ReceiveBufferLength = atoi(Value);
+                } else if (strcmp(Option, "timeout") == 0) {
+                    TimeoutMs = atoi(Value);
+                } else if (strcmp(Option, "timestamps") == 0) {
+                    m_Timestamps = atoi(Value) != 0;
+                } else {
+                    return -1;
+                }
+            }
+
+            sockaddr_in Local = {};
+            Local.sin_family = AF_INET;
+            Local.sin_port = htons((uint16_t) Port);
+            Local.sin_addr.s_addr = htonl(INADDR_ANY);
+            if (Address[0] != '\0' and inet_pton(AF_INET, Address, &Local.sin_addr) != 1) return -1;
+            bool Multicast = IN_MULTICAST(ntohl(Local.sin_addr.s_addr));
+
+            m_Socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            if (m_Socket < 0) return -1;
+
+            //size the socket queue so bursts survive scheduling hiccups, FORCE needs CAP_NET_ADMIN
+            int On = 1;
+            setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, &On, sizeof(On));
+            if (setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUFFORCE, &ReceiveBufferLength, sizeof(ReceiveBufferLength)) != 0) {
+                setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &ReceiveBufferLength, sizeof(ReceiveBufferLength));
+            }
+            setsockopt(m_Socket, SOL_SOCKET, SO_RXQ_OVFL, &On, sizeof(On));
+            if (m_Timestamps) m_Timestamps = setsockopt(m_Socket, SOL_SOCKET, SO_TIMESTAMPNS, &On, sizeof(On)) == 0;
+            if (TimeoutMs > 0) {
+                timeval Timeout = {TimeoutMs / 1000, (TimeoutMs % 1000) * 1000};
+                setsockopt(m_Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+            }
+
+            if (bind(m_Socket, (const sockaddr *) &Local, sizeof(Local)) != 0) {
+                Close();
+                return -1;
+            }
+            if (Multicast) {
+                ip_mreq Membership = {};
+                Membership.imr_multiaddr = Local.sin_addr;
+                Membership.imr_interface = Interface;
+                if (setsockopt(m_Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &Membership, sizeof(Membership)) != 0) {
+                    Close();
+                    return -1;
+                }
+            }
+
+            //carry never exceeds scanner's lock window, slots are laid out behind it
+            m_Capacity = xTS::InputBlockAlignment + (size_t) NumMessages * MaxDatagramLength;
+            m_Buffer = (uint8_t *) aligned_alloc(xTS::InputBlockAlignment, m_Capacity);
+            m_Overflow = (uint8_t *) malloc((size_t) NumMessages * MaxDatagramLength);
+            if (m_Buffer == nullptr or m_Overflow == nullptr) {
+                Close();
+                return -1;
+            }
+            m_Begin = m_End = 0;
+            m_EndOfInput = false;
+            m_Arrivals.reserve(4 * NumMessages);
+            return 0;
+        }
+
+        void Close() override {
+            if (m_Socket >= 0) close(m_Socket);
+            free(m_Buffer);
+            free(m_Overflow);
+            m_Buffer = nullptr;
+            m_Overflow = nullptr;
+            m_Socket = -1;
+        }
+
+        const uint8_t *Acquire(size_t &NumBytes, size_t MinBytes = xTS::TS_PacketLength) override {
+            while (m_End - m_Begin < MinBytes and !m_EndOfInput) {
+                xReceive();
+            }
+            if (m_End - m_Begin < MinBytes or m_End == m_Begin) return nullptr;
+            NumBytes = m_End - m_Begin;
+            return m_Buffer + m_Begin;
+        }
+
+        void Release(size_t NumBytes) override {
+            m_Begin += NumBytes;
+            xTS_Input::Release(NumBytes);
+        }
+
+        //a signal interrupts recvmmsg (EINTR), the capture ends when it set the flag
+        bool SetStopFlag(const volatile sig_atomic_t *StopFlag) override {
+            m_StopFlag = StopFlag;
+            return true;
+        }
+
+        int64_t getArrivalTime(uint64_t ByteOffset) const override {
+            //few dozen entries, newest datagrams are searched first
+            for (size_t Idx = m_Arrivals.size(); Idx-- > 0; ) {
+                if (m_Arrivals[Idx].ByteOffset <= ByteOffset) return m_Arrivals[Idx].Time;
+            }
+            return -1;
+        }
+
+        void PrintStats() const override {
+            printf("UDP: Datagrams=%lu Batches=%lu AvgBatch=%.1f Compacted=%lu Truncated=%lu KernelDrops=%u\n",
+                   m_NumDatagrams, m_NumBatches, m_NumBatches ? (double) m_NumDatagrams / m_NumBatches : 0.0,
+                   m_NumCompactedBatches, m_NumTruncated, m_NumKernelDrops);
+            if (m_RTP) {
+                printf("RTP: Lost=%lu Gaps=%lu Reordered=%lu Invalid=%lu\n", m_NumRTPLost, m_NumRTPGaps, m_NumRTPReordered, m_NumInvalidRTP);
+            }
+        }
+
+    protected:
+        void xReceive() {
+            //move unconsumed tail to the front, slots follow it
+            if (m_Begin != 0) {
+                memmove(m_Buffer, m_Buffer + m_Begin, m_End - m_Begin);
+                m_End -= m_Begin;
+                m_Begin = 0;
+            }
+            xPruneArrivals();
+
+            //scatter: RTP header aside, payload straight into its contiguous slot, anything longer into overflow
+            for (uint32_t Idx = 0; Idx < NumMessages; Idx++) {
+                iovec *Vectors = m_Vectors[Idx];
+                uint32_t NumVectors = 0;
+                if (m_RTP) Vectors[NumVectors++] = {m_Headers[Idx], RTP_HeaderLength};
+                Vectors[NumVectors++] = {m_Buffer + m_End + (size_t) Idx * m_SlotLength, m_SlotLength};
+                Vectors[NumVectors++] = {m_Overflow + (size_t) Idx * MaxDatagramLength, MaxDatagramLength - m_SlotLength};
+                msghdr &Header = m_Messages[Idx].msg_hdr;
+                Header = {};
+                Header.msg_iov = Vectors;
+                Header.msg_iovlen = NumVectors;
+                Header.msg_control = m_Control[Idx];
+                Header.msg_controllen = ControlLength;
+            }
+
+            int NumReceived = recvmmsg(m_Socket, m_Messages, NumMessages, MSG_WAITFORONE, nullptr);
+            if (NumReceived <= 0) {
+                if (NumReceived < 0 and errno == EINTR and (m_StopFlag == nullptr or *m_StopFlag == 0)) return;
+                m_EndOfInput = true;
+                return;
+            }
+            m_NumBatches++;
+            m_NumDatagrams += NumReceived;
+
+            //common case: every datagram filled its slot exactly, the payloads are already contiguous
+            bool InPlace = true;
+            uint32_t HeaderLength = m_RTP ? RTP_HeaderLength : 0;
+            for (int Idx = 0; Idx < NumReceived; Idx++) {
+                xAbsorbControl(m_Messages[Idx].msg_hdr);
+                if (m_Messages[Idx].msg_hdr.msg_flags & MSG_TRUNC) m_NumTruncated++;
+                //plain RTP v2 header: no padding, extension or CSRCs
+                if (m_Messages[Idx].msg_len != HeaderLength + m_SlotLength or (m_RTP and m_Headers[Idx][0] != 0x80)) InPlace = false;
+            }
+
+            if (InPlace) {
+                for (int Idx = 0; Idx < NumReceived; Idx++) {
+                    if (m_RTP) xCheckRTP(m_Headers[Idx]);
+                    xAddArrival(Idx, m_End + (size_t) Idx * m_SlotLength);
+                }
+                m_End += (size_t) NumReceived * m_SlotLength;
+                return;
+            }
+
+            //short/long datagrams or RTP extensions: compact through spill buffer in arrival order
+            m_NumCompactedBatches++;
+            m_Spill.clear();
+            uint32_t LastLength = 0;
+            for (int Idx = 0; Idx < NumReceived; Idx++) {
+                if (m_Messages[Idx].msg_len < HeaderLength) continue;
+                uint32_t Length = m_Messages[Idx].msg_len - HeaderLength;
+                if (Length > MaxDatagramLength - HeaderLength) Length = MaxDatagramLength - HeaderLength;
+
+                size_t SpillBegin = m_Spill.size();
+                const uint8_t *Slot = m_Buffer + m_End + (size_t) Idx * m_SlotLength;
+                uint32_t InSlot = Length < m_SlotLength ? Length : m_SlotLength;
+                m_Spill.insert(m_Spill.end(), Slot, Slot + InSlot);
+                if (Length > InSlot) {
+                    const uint8_t *Overflow = m_Overflow + (size_t) Idx * MaxDatagramLength;
+                    m_Spill.insert(m_Spill.end(), Overflow, Overflow + (Length - InSlot));
+                }
+
+                if (m_RTP) {
+                    const uint8_t *RTP = m_Headers[Idx];
+                    if (!xCheckRTP(RTP)) {
+                        m_Spill.resize(SpillBegin);
+                        continue;
+                    }
+                    //CSRC list and header extension precede payload, padding count is in the last byte
+                    uint32_t Skip = 4 * (RTP[0] & 0x0F);
+                    if ((RTP[0] & 0x10) and Length >= Skip + 4) {
+                        const uint8_t *Extension = m_Spill.data() + SpillBegin + Skip;
+                        Skip += 4 + 4 * ((uint32_t) Extension[2] << 8 | Extension[3]);
+                    }
+                    uint32_t Padding = (RTP[0] & 0x20) and Length > 0 ? m_Spill.back() : 0;
+                    if (Skip + Padding > Length) {
+                        m_NumInvalidRTP++;
+                        m_Spill.resize(SpillBegin);
+                        continue;
+                    }
+                    m_Spill.erase(m_Spill.begin() + SpillBegin, m_Spill.begin() + SpillBegin + Skip);
+                    m_Spill.resize(m_Spill.size() - Padding);
+                }
+                xAddArrival(Idx, m_End + SpillBegin);
+                LastLength = Length;
+            }
+            memcpy(m_Buffer + m_End, m_Spill.data(), m_Spill.size());
+            m_End += m_Spill.size();
+
+            //follow the sender's datagram size so following batches land in place again
+            if (LastLength >= xTS::TS_PacketLength and LastLength <= MaxDatagramLength - xTS::TS_PacketLength) m_SlotLength = LastLength;
+        }
+
+        //returns false for datagrams that are not RTP version 2
+        bool xCheckRTP(const uint8_t *RTP) {
+            if ((RTP[0] >> 6) != 2) {
+                m_NumInvalidRTP++;
+                return false;
+            }
+            uint16_t Sequence = (uint16_t) RTP[2] << 8 | RTP[3];
+            if (m_SequenceKnown and Sequence != m_ExpectedSequence) {
+                uint16_t Distance = Sequence - m_ExpectedSequence;
+                if (Distance < 0x8000) {
+                    m_NumRTPLost += Distance;
+                    m_NumRTPGaps++;
+                } else {
+                    //late or duplicated datagram, expected sequence stays
+                    m_NumRTPReordered++;
+                    return true;
+                }
+            }
+            m_ExpectedSequence = Sequence + 1;
+            m_SequenceKnown = true;
+            return true;
+        }
+
+        void xAbsorbControl(const msghdr &Header) {
+            for (cmsghdr *Control = CMSG_FIRSTHDR(&Header); Control != nullptr; Control = CMSG_NXTHDR((msghdr *) &Header, Control)) {
+                if (Control->cmsg_level != SOL_SOCKET) continue;
+                if (Control->cmsg_type == SO_RXQ_OVFL) memcpy(&m_NumKernelDrops, CMSG_DATA(Control), sizeof(m_NumKernelDrops));
+            }
+        }
+
+        void xAddArrival(int Idx, size_t BufferOffset) {
+            int64_t Time = -1;
+            const msghdr &Header = m_Messages[Idx].msg_hdr;
+            if (m_Timestamps) {
+                for (cmsghdr *Control = CMSG_FIRSTHDR(&Header); Control != nullptr; Control = CMSG_NXTHDR((msghdr *) &Header, Control)) {
+                    if (Control->cmsg_level != SOL_SOCKET or Control->cmsg_type != SCM_TIMESTAMPNS) continue;
+                    timespec Stamp;
+                    memcpy(&Stamp, CMSG_DATA(Control), sizeof(Stamp));
+                    Time = (int64_t) Stamp.tv_sec * 1000000000 + Stamp.tv_nsec;
+                }
+            }
+            if (Time < 0) {
+                timespec Now;
+                clock_gettime(CLOCK_REALTIME, &Now);
+                Time = (int64_t) Now.tv_sec * 1000000000 + Now.tv_nsec;
+            }
+            m_Arrivals.push_back({m_NumConsumedBytes + (BufferOffset - m_Begin), Time});
+        }
+
+        //drops arrivals of datagrams that were consumed completely
+        void xPruneArrivals() {
+            size_t Keep = 0;
+            while (Keep + 1 < m_Arrivals.size() and m_Arrivals[Keep + 1].ByteOffset <= m_NumConsumedBytes) Keep++;
+            if (Keep != 0) m_Arrivals.erase(m_Arrivals.begin(), m_Arrivals.begin() + Keep);
+        }
+};
+
+xTS_Input *xTS_Input::Create(const char *Path) {
+    if (xTS_UdpInput::isURL(Path)) {
+        xTS_UdpInput *Input = new xTS_UdpInput;
+        if (Input->Open(Path) == 0) return Input;
+        delete Input;
+        return nullptr;
+    }
+
+    if (strcmp(Path, "-") != 0) {
+        xTS_MmapInput *Input = new xTS_MmapInput;
+        if (Input->Open(Path) == 0) return Input;
+        delete Input;
+    }
+
+    //stdin, pipes, FIFOs and anything that cannot be mapped
+    xTS_BlockInput *Input = new xTS_BlockInput;
+    if (Input->Open(Path) == 0) return Input;
+    delete Input;
+    return nullptr;
+}
+
+//bounded lock-free single-producer/single-consumer ring, slots are filled and consumed in place
+template <typename tElement>
+class xSPSC_Ring {
+    protected:
+        tElement *m_Slots = nullptr;
+        uint32_t m_Mask = 0;
+        alignas(64) atomic<uint32_t> m_Head{0};     //next slot to consume
+        uint32_t m_CachedTail = 0;                  //consumer's copy of m_Tail
+        alignas(64) atomic<uint32_t> m_Tail{0};     //next slot to produce
+        uint32_t m_CachedHead = 0;                  //producer's copy of m_Head
+        uint64_t m_NumProducerStalls = 0;
+
+    public:
+        explicit xSPSC_Ring(uint32_t Capacity) {
+            uint32_t RoundedCapacity = 1;
+            while (RoundedCapacity < Capacity) RoundedCapacity *= 2;
+            m_Slots = new tElement[RoundedCapacity];
+            m_Mask = RoundedCapacity - 1;
+        }
+
+        xSPSC_Ring(const xSPSC_Ring &) = delete;
+        xSPSC_Ring &operator=(const xSPSC_Ring &) = delete;
+
+        ~xSPSC_Ring() { delete[] m_Slots; }
+
+        //producer side, nullptr when full
+        tElement *getBack() {
+            uint32_t Tail = m_Tail.load(memory_order_relaxed);
+            if (Tail - m_CachedHead > m_Mask) {
+                m_CachedHead = m_Head.load(memory_order_acquire);
+                if (Tail - m_CachedHead > m_Mask) return nullptr;
+            }
+            return &m_Slots[Tail & m_Mask];
+        }
+
+        //blocks while full (backpressure)
+        tElement *WaitBack() {
+            tElement *Slot;
+            uint32_t NumSpins = 0;
+            while ((Slot = getBack()) == nullptr) {
+                if (NumSpins == 0) m_NumProducerStalls++;
+                xBackoff(NumSpins);
+            }
+            return Slot;
+        }
+
+        void Push() { m_Tail.store(m_Tail.load(memory_order_relaxed) + 1, memory_order_release); }
+
+        //consumer side, nullptr when empty
+        tElement *getFront() {
+            uint32_t Head = m_Head.load(memory_order_relaxed);
+            if (Head == m_CachedTail) {
+                m_CachedTail = m_Tail.load(memory_order_acquire);
+                if (Head == m_CachedTail) return nullptr;
+            }
+            return &m_Slots[Head & m_Mask];
+        }
+
+        tElement *WaitFront() {
+            tElement *Slot;
+            uint32_t NumSpins = 0;
+            while ((Slot = getFront()) == nullptr) xBackoff(NumSpins);
+            return Slot;
+        }
+
+        void Pop() { m_Head.store(m_Head.load(memory_order_relaxed) + 1, memory_order_release); }
+
+        uint32_t getCapacity() const { return m_Mask + 1; }
+        uint64_t getNumProducerStalls() const { return m_NumProducerStalls; }
+
+    protected:
+        static void xBackoff(uint32_t &NumSpins) {
+            if (++NumSpins < 64) {
+#ifdef TS_PARSER_X86
+                _mm_pause();
+#endif
+            } else {
+                this_thread::yield();
+            }
+        }
+};
+
+//reader -> demux: run of aligned packets, NumPackets == 0 ends the stream
+struct xTS_PacketBlock {
+    const uint8_t *Data;
+    uint32_t NumPackets;
+    uint32_t Stride;
+    uint8_t *Buffer;    //pool buffer holding a copy of the packets, nullptr when Data points into the input
+};
+
+//demux -> worker: single packet, copied unless the input keeps it alive
+struct xTS_PacketSlot {
+    const uint8_t *Packet;
+    bool EndOfStream;
+    bool Lost;          //packets of this PID were lost or damaged before this one
+    uint8_t Data[xTS::TS_PacketLength];
+};
+
+//reader, demux and assembler worker threads connected by SPSC rings
+class xTS_Pipeline {
+    public:
+        static constexpr uint32_t NumBlocks = 16;
+        static constexpr uint32_t PacketRingCapacity = 16384;
+        static constexpr uint32_t BlockBufferLength = xTS_PacketTable::MaxNumPackets * xTS::FEC_PacketLength;
+
+    protected:
+        xTS_Input *m_Input = nullptr;
+        bool m_Persistent = false;
+        uint32_t m_NumWorkers = 0;
+        int16_t m_WorkerOf[xTS_Demux::NumPIDs];     //-1 - drop
+        xTS_SyncScanner m_SyncScanner;
+        xSPSC_Ring<xTS_PacketBlock> m_BlockRing{NumBlocks};
+        xSPSC_Ring<uint8_t *> m_FreeRing{NumBlocks};
+        vector<uint8_t *> m_BlockBuffers;
+        vector<xSPSC_Ring<xTS_PacketSlot> *> m_PacketRings;
+        vector<xTS_Demux *> m_WorkerDemuxes;
+        xTS_ContinuityMonitor *m_Monitor = new xTS_ContinuityMonitor;
+        uint64_t m_NumPackets = 0;
+
+    public:
+        ~xTS_Pipeline() {
+            delete m_Monitor;
+            for (xSPSC_Ring<xTS_PacketSlot> *Ring : m_PacketRings) delete Ring;
+            for (xTS_Demux *Demux : m_WorkerDemuxes) delete Demux;
+            for (uint8_t *Buffer : m_BlockBuffers) free(Buffer);
+        }
+
+        //PIDs are spread over workers round robin in the order given, StreamTypes per PID pick the length policy
+        int32_t Init(xTS_Input *Input, uint32_t NumWorkers, const vector<const char *> &PIDArguments,
+                     const vector<uint8_t> &StreamTypes, bool ZeroCopy, bool DropCorrupt) {
+            m_Input = Input;
+            m_Persistent = Input->isPersistent();
+            m_NumWorkers = NumWorkers;
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) m_WorkerOf[PID] = -1;
+
+            for (uint32_t WorkerIdx = 0; WorkerIdx < m_NumWorkers; WorkerIdx++) {
+                m_PacketRings.push_back(new xSPSC_Ring<xTS_PacketSlot>(PacketRingCapacity));
+                m_WorkerDemuxes.push_back(new xTS_Demux);
+            }
+
+            for (uint32_t ArgumentIdx = 0; ArgumentIdx < PIDArguments.size(); ArgumentIdx++) {
+                uint32_t WorkerIdx = ArgumentIdx % m_NumWorkers;
+                int32_t PID = -1;
+                char DefaultPath[32];
+                bool Valid = xTS_Demux::ParseArgument(PIDArguments[ArgumentIdx], PID, DefaultPath, sizeof(DefaultPath)) != nullptr;
+                PID = m_WorkerDemuxes[WorkerIdx]->RegisterFromArgument(PIDArguments[ArgumentIdx], ZeroCopy and m_Persistent, DropCorrupt, false,
+                                                                       Valid ? StreamTypes[PID] : 0);
+                if (PID < 0 or m_WorkerOf[PID] != -1) {
+                    printf("wrong PID or output file: %s\n", PIDArguments[ArgumentIdx]);
+                    return -1;
+                }
+                m_WorkerOf[PID] = WorkerIdx;
+            }
+
+            if (!m_Persistent) {
+                for (uint32_t BlockIdx = 0; BlockIdx < NumBlocks; BlockIdx++) {
+                    uint8_t *Buffer = (uint8_t *) aligned_alloc(xTS::InputBlockAlignment, BlockBufferLength);
+                    if (Buffer == nullptr) return -1;
+                    m_BlockBuffers.push_back(Buffer);
+                    *m_FreeRing.getBack() = Buffer;
+                    m_FreeRing.Push();
+                }
+            }
+            return 0;
+        }
+
+        void Run() {
+            vector<thread> Workers;
+            for (uint32_t WorkerIdx = 0; WorkerIdx < m_NumWorkers; WorkerIdx++) {
+                Workers.emplace_back(&xTS_Pipeline::xWorker, this, WorkerIdx);
+            }
+            thread Demux(&xTS_Pipeline::xDemux, this);
+            xReader();
+
+            Demux.join();
+            for (thread &Worker : Workers) Worker.join();
+        }
+
+        void PrintStats() const {
+            m_SyncScanner.Print();
+            m_Monitor->PrintReport(m_SyncScanner.getNumSyncLosses(), m_SyncScanner.getNumSyncByteErrors());
+            printf("PIPELINE: Workers=%d Packets=%lu ReaderStalls=%lu\n", m_NumWorkers, m_NumPackets,
+                   m_BlockRing.getNumProducerStalls());
+            for (uint32_t WorkerIdx = 0; WorkerIdx < m_NumWorkers; WorkerIdx++) {
+                printf("PIPELINE: Worker=%d DemuxStalls=%lu\n", WorkerIdx, m_PacketRings[WorkerIdx]->getNumProducerStalls());
+                m_WorkerDemuxes[WorkerIdx]->PrintStats();
+            }
+        }
+
+    protected:
+        void xReader() {
+            const uint8_t *InputBlock;
+            size_t NumInputBytes;
+
+            uint64_t Ticks = xTS_Instrument::Begin();
+            bool Final = false;     //input cannot fill a confirmation window any more, the tail is scanned as it is
+            while ((InputBlock = m_Input->Acquire(NumInputBytes, Final ? xTS::TS_PacketLength : m_SyncScanner.getMinBytes())) != nullptr or !Final) {
+                if (InputBlock == nullptr) {
+                    Final = true;
+                    continue;
+                }
+                Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Read, Ticks);
+                size_t NumSkippedBytes;
+                uint32_t NumPackets = m_SyncScanner.Scan(InputBlock, NumInputBytes, NumSkippedBytes, Final);
+                Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Sync, Ticks);
+                if (NumPackets == 0) {
+                    m_Input->Release(NumSkippedBytes);
+                    continue;
+                }
+                if (NumPackets > xTS_PacketTable::MaxNumPackets) NumPackets = xTS_PacketTable::MaxNumPackets;
+                uint32_t Stride = m_SyncScanner.getPacketSize();
+                size_t NumConsumedBytes = m_SyncScanner.getNumBytes(NumPackets, NumInputBytes);
+
+                xTS_PacketBlock *Block = m_BlockRing.WaitBack();
+                Block->NumPackets = NumPackets;
+                Block->Stride = Stride;
+                Block->Buffer = nullptr;
+                Block->Data = InputBlock;
+                if (!m_Persistent) {
+                    uint8_t **Free = m_FreeRing.WaitFront();
+                    Block->Buffer = *Free;
+                    m_FreeRing.Pop();
+                    memcpy(Block->Buffer, InputBlock, NumConsumedBytes);
+                    Block->Data = Block->Buffer;
+                }
+                m_BlockRing.Push();
+                Ticks = xTS_Instrument::Begin();
+                m_Input->Release(NumConsumedBytes);
+            }
+
+            xTS_PacketBlock *Block = m_BlockRing.WaitBack();
+            Block->NumPackets = 0;
+            Block->Buffer = nullptr;
+            m_BlockRing.Push();
+        }
+
+        void xDemux() {
+            xTS_PacketTable *PacketTable = new xTS_PacketTable;
+
+            while (true) {
+                xTS_PacketBlock *Block = m_BlockRing.WaitFront();
+                if (Block->NumPackets == 0) break;
+
+                uint64_t Ticks = xTS_Instrument::Begin();
+                PacketTable->Parse(Block->Data, Block->NumPackets, Block->Stride);
+                xTS_Instrument::End(xTS_Instrument::eStage::Table, Ticks);
+                for (uint32_t PacketIdx = 0; PacketIdx < Block->NumPackets; PacketIdx++) {
+                    const uint8_t *Packet = Block->Data + (size_t) PacketIdx * Block->Stride;
+                    uint16_t PID = PacketTable->getPacketIdentifier(PacketIdx);
+                    Ticks = xTS_Instrument::Begin();
+                    xTS_ContinuityMonitor::eResult Continuity = m_Monitor->Check(Packet, PID,
+                            PacketTable->getContinuityCounter(PacketIdx), PacketTable->getAdaptationFieldControl(PacketIdx),
+                            PacketTable->isTransportErrorIndicator(PacketIdx), PacketTable->getTransportScramblingControl(PacketIdx));
+                    xTS_Instrument::End(xTS_Instrument::eStage::Monitor, Ticks);
+                    xTS_Instrument::CountPacket(PID, Block->Stride);
+
+                    int16_t WorkerIdx = m_WorkerOf[PID];
+                    if (WorkerIdx < 0 or Continuity == xTS_ContinuityMonitor::eResult::Duplicate) continue;
+
+                    xTS_PacketSlot *Slot = m_PacketRings[WorkerIdx]->WaitBack();
+                    Slot->EndOfStream = false;
+                    Slot->Lost = xTS_ContinuityMonitor::isLoss(Continuity);
+                    if (m_Persistent) {
+                        Slot->Packet = Packet;
+                    } else {
+                        memcpy(Slot->Data, Packet, xTS::TS_PacketLength);
+                        Slot->Packet = nullptr;
+                    }
+                    m_PacketRings[WorkerIdx]->Push();
+                }
+                m_NumPackets += Block->NumPackets;
+
+                if (Block->Buffer != nullptr) {
+                    *m_FreeRing.WaitBack() = Block->Buffer;
+                    m_FreeRing.Push();
+                }
+                m_BlockRing.Pop();
+            }
+            m_BlockRing.Pop();
+
+            for (xSPSC_Ring<xTS_PacketSlot> *Ring : m_PacketRings) {
+                Ring->WaitBack()->EndOfStream = true;
+                Ring->Push();
+            }
+            delete PacketTable;
+        }
+
+        void xWorker(uint32_t WorkerIdx) {
+            xSPSC_Ring<xTS_PacketSlot> *Ring = m_PacketRings[WorkerIdx];
+            xTS_Demux *Demux = m_WorkerDemuxes[WorkerIdx];
+            xTS_PacketHeader PacketHeader;
+            xTS_AdaptationField AdaptationField;
+
+            while (true) {
+                xTS_PacketSlot *Slot = Ring->WaitFront();
+                if (Slot->EndOfStream) break;
+
+                const uint8_t *Packet = Slot->Packet != nullptr ? Slot->Packet : Slot->Data;
+                uint64_t Ticks = xTS_Instrument::Begin();
+                PacketHeader.Parse(Packet);
+                Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Header, Ticks);
+                AdaptationField.Reset();
+                if (PacketHeader.hasAdaptationField()) {
+                    AdaptationField.Parse(Packet, PacketHeader.getAdaptationFieldControl());
+                    Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Adaptation, Ticks);
+                }
+                xTS_PacketHandler *Handler = Demux->getHandler(PacketHeader.getPacketIdentifier());
+                if (Handler != nullptr) {
+                    if (Slot->Lost) Handler->SignalLoss();
+                    Handler->Handle(Packet, &PacketHeader, &AdaptationField);
+                    xTS_Instrument::End(xTS_Instrument::eStage::Assembly, Ticks);
+                }
+                Ring->Pop();
+            }
+            Ring->Pop();
+            Demux->Flush();
+        }
+};
+
+//zero-copy assembler of one file chunk, keeps finished PES as slices and captures the payload
+//preceding the first PUSI, which belongs to a PES started in the previous chunk; the length policy follows the
+//stream type like in xPES_AssemblerFactory
+template <class tLength>
+class xPES_ChunkAssembler : public xPES_AssemblerT<tLength, xPES_SliceSink, xPES_MinimalHeader> {
+    protected:
+        typedef xPES_AssemblerT<tLength, xPES_SliceSink, xPES_MinimalHeader> xBase;
+        using xBase::m_PID;
+        using xBase::m_Started;
+        using xBase::m_Corrupt;
+        using xBase::m_DropCorrupt;
+        using xBase::m_NumPES;
+        using xBase::m_NumCorruptPES;
+        using xBase::m_ExpectedSize;
+        using xBase::m_Slices;
+        using xBase::m_NumSliceBytes;
+
+        bool m_SeenStart = false;
+        bool m_HeadLoss = false;            //loss before the first PUSI, the PES of the previous chunk is corrupt
+        vector<iovec> m_HeadSlices;
+        vector<iovec> m_BodySlices;
+
+    public:
+        int32_t Handle(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader,
+                       const xTS_AdaptationField *AdaptationField) override {
+            if (PacketHeader->isPayloadUnitStartIndicator()) {
+                m_SeenStart = true;
+            } else if (!m_SeenStart and PacketHeader->hasPayload()) {
+                uint32_t Offset = xTS::TS_HeaderLength + AdaptationField->getNumBytes();
+                if (Offset < xTS::TS_PacketLength) {
+                    m_HeadSlices.push_back({(void *) (TransportStreamPacket + Offset), xTS::TS_PacketLength - Offset});
+                }
+                return (int32_t) xPES_Assembler::eResult::AssemblingContinue;
+            }
+            return xBase::Handle(TransportStreamPacket, PacketHeader, AdaptationField);
+        }
+
+        void SignalLoss() override {
+            if (!m_SeenStart) m_HeadLoss = true;
+            xBase::SignalLoss();
+        }
+
+        //the open PES lost packets in a later chunk, recounted as corrupt after Flush()
+        void CorruptOpenPES() {
+            if (!m_Started or m_Corrupt) return;
+            m_Corrupt = true;
+            m_NumCorruptPES++;
+            if (m_DropCorrupt) {
+                m_NumPES--;
+                m_Started = false;
+            }
+        }
+
+        //counts the PES still open at the chunk end like xFinish() does, its slices stay open for the stitch
+        void Flush() override {
+            if (!m_Started) return;
+            if (m_Corrupt) {
+                m_NumCorruptPES++;
+                if (m_DropCorrupt) {
+                    m_Started = false;
+                    return;
+                }
+            }
+            xTS_Instrument::CountPES(m_PID);
+            m_NumPES++;
+        }
+
+        bool hasSeenStart() const { return m_SeenStart; }
+        bool hasHeadLoss() const { return m_HeadLoss; }
+        bool hasOpenPES() const { return m_Started; }
+        vector<iovec> &getHeadSlices() { return m_HeadSlices; }
+        vector<iovec> &getBodySlices() { return m_BodySlices; }
+        vector<iovec> &getOpenSlices() { return m_Slices; }
+        //bytes the open PES still accepts, UINT32_MAX when unbounded
+        uint32_t getOpenRemaining() const {
+            if (!tLength::Clamp or m_ExpectedSize == UINT32_MAX) return UINT32_MAX;
+            return m_ExpectedSize - m_NumSliceBytes;
+        }
+
+    protected:
+        void xBufferWrite() override {
+            xTS_Instrument::CountPES(m_PID);
+            m_BodySlices.insert(m_BodySlices.end(), m_Slices.begin(), m_Slices.end());
+            m_NumPES++;
+        }
+};
+
+//splits a mapped file in aligned chunks parsed on separate threads, PES cut at chunk borders are stitched back
+class xTS_ChunkedExtractor {
+    public:
+        //smaller chunks are not worth a thread and may be too short to confirm a lattice of their own
+        static constexpr size_t MinChunkSize = 8 * ((xTS_SyncScanner::NumConfirmPackets - 1) * xTS::FEC_PacketLength + xTS::TS_PacketLength);
+
+    protected:
+        struct xOutput {
+            int32_t PID;
+            string Path;
+            bool Unbounded;     //video, PES_packet_length does not end the PES
+        };
+
+        const uint8_t *m_Data = nullptr;
+        size_t m_Size = 0;
+        uint32_t m_NumChunks = 0;
+        vector<xOutput> m_Outputs;
+        vector<size_t> m_ChunkBegins;           //m_NumChunks + 1 entries, last one is m_Size
+        vector<uint32_t> m_ChunkPacketSizes;    //lattice inherited at the chunk begin, 0 - confirmed by the chunk itself
+        vector<xTS_Demux *> m_ChunkDemuxes;
+        vector<xTS_SyncScanner> m_ChunkScanners;
+        vector<xTS_ContinuityMonitor *> m_ChunkMonitors;
+        vector<uint64_t> m_ChunkNumPackets;
+
+    public:
+        ~xTS_ChunkedExtractor() {
+            for (xTS_Demux *Demux : m_ChunkDemuxes) delete Demux;
+            for (xTS_ContinuityMonitor *Monitor : m_ChunkMonitors) delete Monitor;
+        }
+
+        //StreamTypes per PID pick the length policy of the chunk assemblers
+        int32_t Init(const xTS_MmapInput *Input, uint32_t NumChunks, const vector<const char *> &PIDArguments,
+                     const vector<uint8_t> &StreamTypes, bool DropCorrupt) {
+            m_Data = Input->getData();
+            m_Size = Input->getSize();
+            m_NumChunks = m_Size / MinChunkSize < NumChunks ? m_Size / MinChunkSize : NumChunks;
+            if (m_NumChunks == 0) m_NumChunks = 1;
+
+            for (const char *Argument : PIDArguments) {
+                int32_t PID;
+                char DefaultPath[32];
+                const char *OutputPath = xTS_Demux::ParseArgument(Argument, PID, DefaultPath, sizeof(DefaultPath));
+                if (OutputPath == nullptr) {
+                    printf("wrong PID or output file: %s\n", Argument);
+                    return -1;
+                }
+                m_Outputs.push_back({PID, OutputPath, xPES_AssemblerFactory::isUnboundedStreamType(StreamTypes[PID])});
+            }
+
+            m_ChunkScanners.resize(m_NumChunks);
+            m_ChunkNumPackets.resize(m_NumChunks, 0);
+            for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                xTS_Demux *Demux = new xTS_Demux;
+                for (const xOutput &Output : m_Outputs) {
+                    xPES_Assembler *Assembler = Output.Unbounded ? (xPES_Assembler *) new xPES_ChunkAssembler<xPES_UnboundedLength>
+                                                                 : (xPES_Assembler *) new xPES_ChunkAssembler<xPES_BoundedLength>;
+                    Assembler->SetStreamType(StreamTypes[Output.PID]);
+                    Assembler->Init(Output.PID, nullptr, DropCorrupt);
+                    if (Demux->Register(Output.PID, Assembler) != 0) {
+                        delete Assembler;
+                        printf("PID %d given twice\n", Output.PID);
+                        return -1;
+                    }
+                }
+                m_ChunkDemuxes.push_back(Demux);
+                m_ChunkMonitors.push_back(new xTS_ContinuityMonitor);
+            }
+
+            xSplit();
+            return 0;
+        }
+
+        int32_t Run() {
+            vector<thread> Threads;
+            for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                Threads.emplace_back(&xTS_ChunkedExtractor::xParseChunk, this, ChunkIdx);
+            }
+            for (thread &Thread : Threads) Thread.join();
+            return xStitch();
+        }
+
+        //continuity across chunk borders is not checked, the first packet of each PID in a chunk has no reference
+        void PrintStats() const {
+            xTS_ContinuityMonitor *Monitor = new xTS_ContinuityMonitor;
+            uint32_t NumSyncLosses = 0;
+            uint32_t NumSyncByteErrors = 0;
+            for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                printf("CHUNK: Idx=%d Begin=%zu End=%zu Packets=%lu ", ChunkIdx, m_ChunkBegins[ChunkIdx],
+                       m_ChunkBegins[ChunkIdx + 1], m_ChunkNumPackets[ChunkIdx]);
+                m_ChunkScanners[ChunkIdx].Print();
+                Monitor->Merge(*m_ChunkMonitors[ChunkIdx]);
+                NumSyncLosses += m_ChunkScanners[ChunkIdx].getNumSyncLosses();
+                NumSyncByteErrors += m_ChunkScanners[ChunkIdx].getNumSyncByteErrors();
+            }
+            Monitor->PrintReport(NumSyncLosses, NumSyncByteErrors);
+            delete Monitor;
+
+            for (const xOutput &Output : m_Outputs) {
+                uint32_t NumPES = 0;
+                uint32_t NumCorruptPES = 0;
+                for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                    const xPES_Assembler *Assembler = (const xPES_Assembler *) m_ChunkDemuxes[ChunkIdx]->getHandler(Output.PID);
+                    NumPES += Assembler->getNumPES();
+                    NumCorruptPES += Assembler->getNumCorruptPES();
+                }
+                printf("PES: PID=%4d NumPES=%d Corrupt=%d\n", Output.PID, NumPES, NumCorruptPES);
+            }
+        }
+
+    protected:
+        //chunk borders are placed on the lattice of the previous chunk when a sync byte is found there,
+        //otherwise moved forward to the first confirmed sync
+        void xSplit() {
+            m_ChunkBegins.assign(m_NumChunks + 1, m_Size);
+            m_ChunkPacketSizes.assign(m_NumChunks, 0);
+            m_ChunkBegins[0] = 0;
+            size_t LatticeBegin = 0;
+            uint32_t PacketSize = 0;
+            for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                size_t Begin = m_Size / m_NumChunks * ChunkIdx;
+                if (ChunkIdx > 0 and Begin < m_ChunkBegins[ChunkIdx - 1]) Begin = m_ChunkBegins[ChunkIdx - 1];
+
+                if (PacketSize != 0) {
+                    if (Begin < LatticeBegin) Begin = LatticeBegin;
+                    size_t Aligned = LatticeBegin + (Begin - LatticeBegin + PacketSize - 1) / PacketSize * PacketSize;
+                    if (Aligned + xTS::TS_PacketLength <= m_Size and m_Data[Aligned] == xTS::TS_SyncByte) {
+                        m_ChunkBegins[ChunkIdx] = Aligned;
+                        m_ChunkPacketSizes[ChunkIdx] = PacketSize;
+                        LatticeBegin = Aligned;
+                        continue;
+                    }
+                }
+
+                xTS_SyncScanner Scanner;
+                while (Begin < m_Size) {
+                    size_t NumSkippedBytes;
+                    if (Scanner.Scan(m_Data + Begin, m_Size - Begin, NumSkippedBytes, true) != 0 or NumSkippedBytes == 0) break;
+                    Begin += NumSkippedBytes;
+                    if (Scanner.isLocked()) break;
+                }
+                if (Scanner.isLocked()) {
+                    PacketSize = Scanner.getPacketSize();
+                    LatticeBegin = Begin;
+                } else {
+                    Begin = m_Size;
+                }
+                if (ChunkIdx > 0) m_ChunkBegins[ChunkIdx] = Begin;    //the first chunk keeps its leading bytes as skipped
+            }
+        }
+
+        void xParseChunk(uint32_t ChunkIdx) {
+            xTS_SyncScanner &Scanner = m_ChunkScanners[ChunkIdx];
+            xTS_ContinuityMonitor *Monitor = m_ChunkMonitors[ChunkIdx];
+            xTS_Demux *Demux = m_ChunkDemuxes[ChunkIdx];
+            xTS_PacketHeader PacketHeader;
+            xTS_AdaptationField AdaptationField;
+            size_t Position = m_ChunkBegins[ChunkIdx];
+            size_t End = m_ChunkBegins[ChunkIdx + 1];
+            //a lattice lost near the chunk end is confirmed with the bytes of the next chunk
+            size_t ScanEnd = End + Scanner.getMinBytes() < m_Size ? End + Scanner.getMinBytes() : m_Size;
+            if (m_ChunkPacketSizes[ChunkIdx] != 0) Scanner.Assume(m_ChunkPacketSizes[ChunkIdx]);
+
+            while (Position < End and Position + xTS::TS_PacketLength <= m_Size) {    //partial last packet is ignored
+                size_t NumSkippedBytes;
+                uint64_t Ticks = xTS_Instrument::Begin();
+                uint32_t NumPackets = Scanner.Scan(m_Data + Position, ScanEnd - Position, NumSkippedBytes, ScanEnd == m_Size);
+                xTS_Instrument::End(xTS_Instrument::eStage::Sync, Ticks);
+                if (NumPackets != 0) {
+                    size_t MaxPackets = (End - Position + Scanner.getPacketSize() - 1) / Scanner.getPacketSize();
+                    if (NumPackets > MaxPackets) NumPackets = MaxPackets;
+                }
+                if (NumPackets == 0) {
+                    if (NumSkippedBytes == 0 and !Scanner.isLocked()) break;    //tail too short to confirm sync
+                    Position += NumSkippedBytes;
+                    continue;
+                }
+                for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++) {
+                    const uint8_t *Packet = m_Data + Position + (size_t) PacketIdx * Scanner.getPacketSize();
+                    Ticks = xTS_Instrument::Begin();
+                    PacketHeader.Parse(Packet);
+                    Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Header, Ticks);
+                    xTS_ContinuityMonitor::eResult Continuity = Monitor->Check(Packet, &PacketHeader);
+                    Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Monitor, Ticks);
+                    xTS_Instrument::CountPacket(PacketHeader.getPacketIdentifier(), Scanner.getPacketSize());
+                    xTS_PacketHandler *Handler = Demux->getHandler(PacketHeader.getPacketIdentifier());
+                    if (Handler == nullptr or Continuity == xTS_ContinuityMonitor::eResult::Duplicate) continue;
+                    AdaptationField.Reset();
+                    if (PacketHeader.hasAdaptationField()) {
+                        AdaptationField.Parse(Packet, PacketHeader.getAdaptationFieldControl());
+                        Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Adaptation, Ticks);
+                    }
+                    if (xTS_ContinuityMonitor::isLoss(Continuity)) Handler->SignalLoss();
+                    Handler->Handle(Packet, &PacketHeader, &AdaptationField);
+                    xTS_Instrument::End(xTS_Instrument::eStage::Assembly, Ticks);
+                }
+                m_ChunkNumPackets[ChunkIdx] += NumPackets;
+                Position += (size_t) NumPackets * Scanner.getPacketSize();
+            }
+            Demux->Flush();
+        }
+
+        //appends Slices to Output taking at most Limit bytes, returns number of bytes taken
+        static uint32_t xAppendSlices(vector<iovec> &Output, const vector<iovec> &Slices, uint32_t Limit) {
+            uint32_t NumBytes = 0;
+            for (const iovec &Slice : Slices) {
+                if (NumBytes >= Limit) break;
+                size_t Length = Slice.iov_len < Limit - NumBytes ? Slice.iov_len : Limit - NumBytes;
+                Output.push_back({Slice.iov_base, Length});
+                NumBytes += Length;
+            }
+            return NumBytes;
+        }
+
+        int32_t xStitch() {
+            for (const xOutput &Output : m_Outputs) {
+                vector<iovec> Slices;
+                if (Output.Unbounded) {
+                    xCollectSlices<xPES_UnboundedLength>(Output, Slices);
+                } else {
+                    xCollectSlices<xPES_BoundedLength>(Output, Slices);
+                }
+
+                FILE *File = fopen(Output.Path.c_str(), "wb");
+                if (File == nullptr) {
+                    printf("cannot write %s\n", Output.Path.c_str());
+                    return -1;
+                }
+                int32_t Result = xPES_Assembler::WriteSlices(fileno(File), Slices.data(), Slices.size());
+                fclose(File);
+                if (Result != 0) return -1;
+            }
+            return 0;
+        }
+
+        //slices of all chunks in file order, PES cut at chunk borders continue with the head of the next chunks
+        template <class tLength>
+        void xCollectSlices(const xOutput &Output, vector<iovec> &Slices) {
+            xPES_ChunkAssembler<tLength> *Owner = nullptr;  //chunk that started the PES continued from an earlier chunk
+            size_t OpenBegin = 0;                           //first slice of that PES
+            uint32_t OpenRemaining = 0;
+
+            for (uint32_t ChunkIdx = 0; ChunkIdx < m_NumChunks; ChunkIdx++) {
+                xPES_ChunkAssembler<tLength> *Assembler = (xPES_ChunkAssembler<tLength> *) m_ChunkDemuxes[ChunkIdx]->getHandler(Output.PID);
+                if (Owner != nullptr and Assembler->hasHeadLoss()) {
+                    Owner->CorruptOpenPES();
+                    if (!Owner->hasOpenPES()) {
+                        Slices.resize(OpenBegin);
+                        Owner = nullptr;
+                    }
+                }
+                if (Owner != nullptr) OpenRemaining -= xAppendSlices(Slices, Assembler->getHeadSlices(), OpenRemaining);
+                if (!Assembler->hasSeenStart()) continue;
+
+                Slices.insert(Slices.end(), Assembler->getBodySlices().begin(), Assembler->getBodySlices().end());
+                Owner = Assembler->hasOpenPES() ? Assembler : nullptr;
+                if (Owner != nullptr) {
+                    OpenBegin = Slices.size();
+                    Slices.insert(Slices.end(), Assembler->getOpenSlices().begin(), Assembler->getOpenSlices().end());
+                    OpenRemaining = Assembler->getOpenRemaining();
+                }
+            }
+        }
+};
+
+//deterministic synthetic multiplex: PAT/PMT, one H.264 video and several AAC audio streams, PCR cadence, adaptation
+//field mix and injected errors, identical output for identical configuration on every platform
+class xTS_Generator {
+    public:
+        struct xConfig {
+            uint64_t NumPackets = 100000;
+            uint64_t Seed = 1;
+            uint32_t NumStreams = 3;            //first is video
+            uint32_t Bitrate = 20000000;        //mux rate, PCR values follow packet positions
+            uint32_t PCRInterval = 30;          //ms
+            uint32_t MinPESLength = 500;        //video payload, audio uses a tenth
+            uint32_t MaxPESLength = 20000;
+            uint32_t AdaptationPercent = 5;     //payload packets with an extra (private data) adaptation field
+            uint32_t ErrorsPerMillion = 0;      //packets dropped, duplicated, with TEI set or broken sync byte
+        };
+
+        static constexpr const char *Options = "n:s:k:b:r:L:A:e:";
+        static constexpr const char *OptionsUsage = "[-n packets] [-s seed] [-k streams] [-b bitrate] [-r pcr_ms] [-L pes_min:pes_max] "
+                                                    "[-A af_percent] [-e errors_per_million]";
+        static constexpr uint16_t PMTPID = 0x20;
+        static constexpr uint16_t FirstStreamPID = 0x100;
+        static constexpr uint32_t KeyframeInterval = 25;
+
+    protected:
+        struct xStream {
+            uint16_t PID;
+            bool Video;
+            vector<uint8_t> PES;
+            size_t Cursor;
+            uint8_t ContinuityCounter;
+            uint64_t PTS;
+            uint64_t NumPES;
+            uint64_t LastPCRPacket;
+            bool Keyframe;
+        };
+
+        xConfig m_Config;
+        uint64_t m_State;
+        vector<xStream> m_Streams;
+        uint8_t m_PSIContinuityCounter[2] = {0, 0};
+        uint64_t m_NumErrors = 0;
+
+    public:
+        explicit xTS_Generator(const xConfig &Config) : m_Config(Config), m_State(Config.Seed) {
+            for (uint32_t StreamIdx = 0; StreamIdx < m_Config.NumStreams; StreamIdx++) {
+                m_Streams.push_back({(uint16_t) (FirstStreamPID + StreamIdx), StreamIdx == 0, {}, 0, 0, 90000, 0, UINT64_MAX, false});
+            }
+        }
+
+        //parses one option of Options, false if it is not valid
+        static bool ParseOption(int Option, const char *Argument, xConfig &Config) {
+            char *End;
+            switch (Option) {
+                case 'n': Config.NumPackets = strtoull(Argument, &End, 0); return *End == '\0' and Config.NumPackets > 0;
+                case 's': Config.Seed = strtoull(Argument, &End, 0); return *End == '\0';
+                case 'k': Config.NumStreams = strtoul(Argument, &End, 0); return *End == '\0' and Config.NumStreams >= 1 and Config.NumStreams <= 32;
+                case 'b': Config.Bitrate = strtoul(Argument, &End, 0); return *End == '\0' and Config.Bitrate >= 1000000;
+                case 'r': Config.PCRInterval = strtoul(Argument, &End, 0); return *End == '\0' and Config.PCRInterval >= 1;
+                case 'L':
+                    Config.MinPESLength = strtoul(Argument, &End, 0);
+                    if (*End != ':') return false;
+                    Config.MaxPESLength = strtoul(End + 1, &End, 0);
+                    return *End == '\0' and Config.MinPESLength >= 100 and Config.MaxPESLength >= Config.MinPESLength and
+                           Config.MaxPESLength <= 1 << 20;
+                case 'A': Config.AdaptationPercent = strtoul(Argument, &End, 0); return *End == '\0' and Config.AdaptationPercent <= 100;
+                case 'e': Config.ErrorsPerMillion = strtoul(Argument, &End, 0); return *End == '\0' and Config.ErrorsPerMillion <= 1000000;
+                default: return false;
+            }
+        }
+
+        //appends the multiplex to Output
+        void Generate(vector<uint8_t> &Output) {
+            uint64_t PSIInterval = (uint64_t) m_Config.Bitrate / 8 / xTS::TS_PacketLength / 10;    //100 ms
+            uint8_t Packet[xTS::TS_PacketLength];
+            Output.reserve(Output.size() + m_Config.NumPackets * xTS::TS_PacketLength);
+
+            for (uint64_t PacketIdx = 0; PacketIdx < m_Config.NumPackets; PacketIdx++) {
+                if (PacketIdx % PSIInterval == 0) xBuildPAT(Packet);
+                else if (PacketIdx % PSIInterval == 1) xBuildPMT(Packet);
+                else xBuildPES(Packet, xPickStream(), PacketIdx);
+
+                if (m_Config.ErrorsPerMillion != 0 and xRange(0, 999999) < m_Config.ErrorsPerMillion) {
+                    m_NumErrors++;
+                    switch (xRange(0, 3)) {
+                        case 0: continue;                                       //lost
+                        case 1: Output.insert(Output.end(), Packet, Packet + sizeof(Packet)); break;   //duplicated
+                        case 2: Packet[1] |= 0b10000000; break;                 //transport_error_indicator
+                        case 3: Packet[0] = xTS::TS_SyncByte ^ 0x01; break;     //sync byte
+                    }
+                }
+                Output.insert(Output.end(), Packet, Packet + sizeof(Packet));
+            }
+        }
+
+        uint64_t getNumErrors() const { return m_NumErrors; }
+
+        static int Main(int argc, char *argv[]) {
+            xConfig Config;
+            int Option;
+            while ((Option = getopt(argc, argv, Options)) != -1) {
+                if (!ParseOption(Option, optarg, Config)) {
+                    printf("usage: generate %s <output.ts>\n", OptionsUsage);
+                    return EXIT_FAILURE;
+                }
+            }
+            if (optind >= argc) {
+                printf("usage: generate %s <output.ts>\n", OptionsUsage);
+                return EXIT_FAILURE;
+            }
+
+            xTS_Generator Generator(Config);
+            vector<uint8_t> Output;
+            Generator.Generate(Output);
+            FILE *File = fopen(argv[optind], "wb");
+            if (File == nullptr or fwrite(Output.data(), 1, Output.size(), File) != Output.size()) {
+                printf("cannot write %s\n", argv[optind]);
+                if (File != nullptr) fclose(File);
+                return EXIT_FAILURE;
+            }
+            fclose(File);
+            printf("GENERATE: Packets=%lu Bytes=%zu Streams=%d Errors=%lu\n", Config.NumPackets, Output.size(), Config.NumStreams,
+                   Generator.getNumErrors());
+            return 0;
+        }
+
+    protected:
+        //splitmix64
+        uint64_t xRandom() {
+            uint64_t Value = (m_State += 0x9E3779B97F4A7C15ull);
+            Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBull;
+            return Value ^ (Value >> 31);
+        }
+        uint32_t xRange(uint32_t Low, uint32_t High) { return Low + (uint32_t) (xRandom() % ((uint64_t) High - Low + 1)); }
+
+        //video gets most of the multiplex
+        xStream &xPickStream() {
+            uint32_t NumAudio = m_Streams.size() - 1;
+            uint32_t Pick = xRange(0, 4 * NumAudio + NumAudio);
+            return Pick <= 4 * NumAudio ? m_Streams[0] : m_Streams[1 + (Pick - 4 * NumAudio - 1)];
+        }
+
+        static void xPutPTS(uint8_t *Output, uint8_t Prefix, uint64_t PTS) {
+            Output[0] = Prefix << 4 | ((PTS >> 30) & 0x07) << 1 | 1;
+            Output[1] = (PTS >> 22) & 0xFF;
+            Output[2] = ((PTS >> 15) & 0x7F) << 1 | 1;
+            Output[3] = (PTS >> 7) & 0xFF;
+            Output[4] = (PTS & 0x7F) << 1 | 1;
+        }
+
+        void xNewPES(xStream &Stream) {
+            vector<uint8_t> &PES = Stream.PES;
+            uint32_t Length = xRange(m_Config.MinPESLength, m_Config.MaxPESLength);
+            if (!Stream.Video) Length /= 10;
+            Stream.Keyframe = Stream.Video and Stream.NumPES % KeyframeInterval == 0;
+            PES.clear();
+
+            uint8_t Header[19] = {0, 0, 1, (uint8_t) (Stream.Video ? 0xE0 : 0xC0), 0, 0, 0x80};
+            uint32_t HeaderLength;
+            if (Stream.Video) {
+                Header[7] = 0xC0;
+                Header[8] = 10;
+                xPutPTS(Header + 9, 0b0011, Stream.PTS);
+                xPutPTS(Header + 14, 0b0001, Stream.PTS - 3600);
+                HeaderLength = 19;
+            } else {
+                Header[7] = 0x80;
+                Header[8] = 5;
+                xPutPTS(Header + 9, 0b0010, Stream.PTS);
+                HeaderLength = 14;
+            }
+            PES.insert(PES.end(), Header, Header + HeaderLength);
+
+            //payload without emulated start codes
+            if (Stream.Video) {
+                static const uint8_t AccessUnitDelimiter[] = {0, 0, 0, 1, 0x09, 0xF0};
+                static const uint8_t KeyframeNALs[] = {0, 0, 0, 1, 0x67, 0x42, 0, 0, 1, 0x68, 0xCE, 0, 0, 1, 0x65, 0x88};
+                static const uint8_t SliceNAL[] = {0, 0, 1, 0x41, 0x9A};
+                PES.insert(PES.end(), AccessUnitDelimiter, AccessUnitDelimiter + sizeof(AccessUnitDelimiter));
+                if (Stream.Keyframe) PES.insert(PES.end(), KeyframeNALs, KeyframeNALs + sizeof(KeyframeNALs));
+                else PES.insert(PES.end(), SliceNAL, SliceNAL + sizeof(SliceNAL));
+            }
+            while (PES.size() < HeaderLength + Length) {
+                uint64_t Value = xRandom() | 0x0101010101010101ull;
+                for (int32_t Shift = 56; Shift >= 0; Shift -= 8) PES.push_back((uint8_t) (Value >> Shift));
+            }
+            PES.resize(HeaderLength + Length);
+
+            if (!Stream.Video) {
+                uint32_t PacketLength = PES.size() - xTS::PES_HeaderLength;
+                PES[4] = PacketLength >> 8;
+                PES[5] = PacketLength & 0xFF;
+            }
+            Stream.PTS += Stream.Video ? 3600 : 1920;
+            Stream.NumPES++;
+            Stream.Cursor = 0;
+        }
+
+        void xBuildPES(uint8_t *Packet, xStream &Stream, uint64_t PacketIdx) {
+            if (Stream.Cursor == Stream.PES.size()) xNewPES(Stream);
+            bool Start = Stream.Cursor == 0;
+            uint64_t PCRPackets = (uint64_t) m_Config.Bitrate / 8 / xTS::TS_PacketLength * m_Config.PCRInterval / 1000;
+            bool PCR = Stream.Video and (Stream.LastPCRPacket == UINT64_MAX or PacketIdx - Stream.LastPCRPacket >= PCRPackets);
+            bool RandomAccess = Start and Stream.Keyframe;
+            bool Private = xRange(0, 99) < m_Config.AdaptationPercent;
+
+            //adaptation field: flags, PCR, private data, stuffing to fit the PES tail
+            uint8_t Field[184];
+            uint32_t FieldLength = 0;
+            if (PCR or RandomAccess or Private) {
+                Field[FieldLength++] = 0;   //length, filled below
+                Field[FieldLength++] = (RandomAccess ? 0x40 : 0) | (PCR ? 0x10 : 0) | (Private ? 0x02 : 0);
+                if (PCR) {
+                    uint64_t Clock = PacketIdx * xTS::TS_PacketLength * 8 * 27000000ull / m_Config.Bitrate;
+                    uint64_t Base = Clock / xTS::BaseToExtendedClockMultiplier;
+                    uint32_t Extension = Clock % xTS::BaseToExtendedClockMultiplier;
+                    Field[FieldLength++] = Base >> 25;
+                    Field[FieldLength++] = Base >> 17;
+                    Field[FieldLength++] = Base >> 9;
+                    Field[FieldLength++] = Base >> 1;
+                    Field[FieldLength++] = (Base & 1) << 7 | 0x7E | Extension >> 8;
+                    Field[FieldLength++] = Extension & 0xFF;
+                    Stream.LastPCRPacket = PacketIdx;
+                }
+                if (Private) {
+                    Field[FieldLength++] = 4;
+                    for (uint32_t Idx = 0; Idx < 4; Idx++) Field[FieldLength++] = 0xA5;
+                }
+            }
+            size_t Remaining = Stream.PES.size() - Stream.Cursor;
+            uint32_t Room = 184 - FieldLength;
+            if (Remaining < Room) {
+                if (FieldLength == 0) Field[FieldLength++] = 0;
+                if (FieldLength == 1 and Remaining < 183) Field[FieldLength++] = 0;
+                while (FieldLength < 184 - Remaining) Field[FieldLength++] = 0xFF;
+                Room = 184 - FieldLength;
+            }
+            if (FieldLength != 0) Field[0] = FieldLength - 1;
+
+            Packet[0] = xTS::TS_SyncByte;
+            Packet[1] = (Start ? 0x40 : 0) | Stream.PID >> 8;
+            Packet[2] = Stream.PID & 0xFF;
+            Packet[3] = (FieldLength != 0 ? 0x30 : 0x10) | Stream.ContinuityCounter;
+            Stream.ContinuityCounter = (Stream.ContinuityCounter + 1) & 0xF;
+            memcpy(Packet + 4, Field, FieldLength);
+            memcpy(Packet + 4 + FieldLength, Stream.PES.data() + Stream.Cursor, Room);
+            Stream.Cursor += Room;
+        }
+
+        void xBuildSection(uint8_t *Packet, uint16_t PID, uint8_t &ContinuityCounter, const uint8_t *Section, uint32_t Length) {
+            memset(Packet, 0xFF, xTS::TS_PacketLength);
+            Packet[0] = xTS::TS_SyncByte;
+            Packet[1] = 0x40 | PID >> 8;
+            Packet[2] = PID & 0xFF;
+            Packet[3] = 0x10 | ContinuityCounter;
+            ContinuityCounter = (ContinuityCounter + 1) & 0xF;
+            Packet[4] = 0;      //pointer_field
+            memcpy(Packet + 5, Section, Length);
+            uint32_t CRC = xPSI_CRC32::Compute(Packet + 5, Length);
+            Packet[5 + Length] = CRC >> 24;
+            Packet[6 + Length] = CRC >> 16;
+            Packet[7 + Length] = CRC >> 8;
+            Packet[8 + Length] = CRC;
+        }
+
+        void xBuildPAT(uint8_t *Packet) {
+            const uint8_t Section[] = {0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, 0xE0 | PMTPID >> 8, PMTPID & 0xFF};
+            xBuildSection(Packet, 0, m_PSIContinuityCounter[0], Section, sizeof(Section));
+        }
+
+        void xBuildPMT(uint8_t *Packet) {
+            uint8_t Section[12 + 32 * 5];
+            uint32_t Length = 12 + 5 * m_Streams.size();
+            uint8_t Header[12] = {0x02, (uint8_t) (0xB0 | (Length + 4 - 3) >> 8), (uint8_t) ((Length + 4 - 3) & 0xFF), 0x00, 0x01, 0xC1,
+                                  0x00, 0x00, (uint8_t) (0xE0 | FirstStreamPID >> 8), FirstStreamPID & 0xFF, 0xF0, 0x00};
+            memcpy(Section, Header, sizeof(Header));
+            for (uint32_t StreamIdx = 0; StreamIdx < m_Streams.size(); StreamIdx++) {
+                uint8_t *Entry = Section + 12 + 5 * StreamIdx;
+                Entry[0] = m_Streams[StreamIdx].Video ? 0x1B : 0x0F;
+                Entry[1] = 0xE0 | m_Streams[StreamIdx].PID >> 8;
+                Entry[2] = m_Streams[StreamIdx].PID & 0xFF;
+                Entry[3] = 0xF0;
+                Entry[4] = 0x00;
+            }
+            xBuildSection(Packet, PMTPID, m_PSIContinuityCounter[1], Section, Length);
+        }
+};
+
+//repeatable throughput numbers for the hot paths: best of several runs over a generated (or given) capture in memory
+class xTS_Benchmark {
+    protected:
+        //extracts every PES stream announced in a PMT to /dev/null
+        class xNullDiscovery : public xTS_ServiceDiscovery {
+            public:
+                xNullDiscovery(xTS_Demux *Demux, xTS_ContinuityMonitor *Monitor) : xTS_ServiceDiscovery(Demux, Monitor) {}
+
+            protected:
+                void xRegisterAssembler(uint16_t PID, uint8_t StreamType) override {
+                    if (getStreamExtension(StreamType) == nullptr or m_Demux->getHandler(PID) != nullptr) return;
+                    xPES_Assembler *Assembler = xPES_AssemblerFactory::Create(PID, "/dev/null", StreamType, false, false, false);
+                    if (Assembler != nullptr and m_Demux->Register(PID, Assembler) != 0) delete Assembler;
+                }
+        };
+
+        const uint8_t *m_Data;
+        size_t m_Size;
+        uint32_t m_NumRepetitions;
+        volatile uint64_t m_Sink = 0;   //keeps results observable
+
+    public:
+        xTS_Benchmark(const uint8_t *Data, size_t Size, uint32_t NumRepetitions) : m_Data(Data), m_Size(Size), m_NumRepetitions(NumRepetitions) {}
+
+        void Run() {
+            uint64_t NumPackets = m_Size / xTS::TS_PacketLength;
+            xMeasure("header", NumPackets, [&]() {
+                xTS_PacketHeader Header;
+                uint64_t Sum = 0;
+                for (size_t Offset = 0; Offset + xTS::TS_PacketLength <= m_Size; Offset += xTS::TS_PacketLength) {
+                    Header.Parse(m_Data + Offset);
+                    Sum += Header.getPacketIdentifier();
+                }
+                return Sum;
+            });
+            xMeasure(string("table-") + xTS_PacketTable::getDecoderName(), NumPackets, [&]() {
+                xTS_PacketTable *Table = new xTS_PacketTable;
+                uint64_t Sum = 0;
+                for (uint64_t First = 0; First < NumPackets; First += xTS_PacketTable::MaxNumPackets) {
+                    uint32_t Count = NumPackets - First < xTS_PacketTable::MaxNumPackets ? NumPackets - First : xTS_PacketTable::MaxNumPackets;
+                    Table->Parse(m_Data + First * xTS::TS_PacketLength, Count, xTS::TS_PacketLength);
+                    Sum += Table->getPacketIdentifier(Count - 1);
+                }
+                delete Table;
+                return Sum;
+            });
+            xMeasure("adaptation", NumPackets, [&]() {
+                xTS_AdaptationField AdaptationField;
+                uint64_t Sum = 0;
+                for (size_t Offset = 0; Offset + xTS::TS_PacketLength <= m_Size; Offset += xTS::TS_PacketLength) {
+                    uint8_t AdaptationFieldControl = (m_Data[Offset + 3] >> 4) & 0b11;
+                    if ((AdaptationFieldControl & 0b10) == 0) continue;
+                    AdaptationField.Reset();
+                    AdaptationField.Parse(m_Data + Offset, AdaptationFieldControl);
+                    Sum += AdaptationField.getNumBytes();
+                }
+                return Sum;
+            });
+            xMeasure("pes-header", NumPackets, [&]() {
+                xPES_PacketHeader Header;
+                uint64_t Sum = 0;
+                for (size_t Offset = 0; Offset + xTS::TS_PacketLength <= m_Size; Offset += xTS::TS_PacketLength) {
+                    const uint8_t *Packet = m_Data + Offset;
+                    if ((Packet[1] & 0x40) == 0 or (Packet[3] & 0x10) == 0) continue;
+                    uint32_t Payload = (Packet[3] & 0x20) ? 5 + Packet[4] : 4;
+                    if (Payload + 19 > xTS::TS_PacketLength or Packet[Payload] != 0 or Packet[Payload + 1] != 0 or Packet[Payload + 2] != 1) continue;
+                    Header.Reset();
+                    Sum += Header.Parse(Packet, Payload);
+                }
+                return Sum;
+            });
+            xMeasure("sync", NumPackets, [&]() {
+                xTS_SyncScanner Scanner;
+                size_t Offset = 0;
+                uint64_t Sum = 0;
+                while (Offset < m_Size) {
+                    size_t NumSkippedBytes;
+                    uint32_t Count = Scanner.Scan(m_Data + Offset, m_Size - Offset, NumSkippedBytes, true);
+                    if (Count == 0 and NumSkippedBytes == 0 and !Scanner.isLocked()) break;
+                    Offset += Count != 0 ? (size_t) Count * Scanner.getPacketSize() : NumSkippedBytes;
+                    Sum += Count;
+                }
+                return Sum;
+            });
+            xMeasure("extract", NumPackets, [&]() { return xExtract(); });
+        }
+
+        static int Main(int argc, char *argv[]) {
+            xTS_Generator::xConfig Config;
+            uint32_t NumRepetitions = 5;
+            string Options = string(xTS_Generator::Options) + "R:";
+            int Option;
+            while ((Option = getopt(argc, argv, Options.c_str())) != -1) {
+                if (Option == 'R' and atoi(optarg) > 0) {
+                    NumRepetitions = atoi(optarg);
+                } else if (Option == 'R' or !xTS_Generator::ParseOption(Option, optarg, Config)) {
+                    printf("usage: bench [-R repetitions] %s [input.ts]\n", xTS_Generator::OptionsUsage);
+                    return EXIT_FAILURE;
+                }
+            }
+
+            //given capture is mapped, otherwise generated with the configuration
+            xTS_MmapInput Input;
+            vector<uint8_t> Generated;
+            const uint8_t *Data;
+            size_t Size;
+            if (optind < argc) {
+                if (Input.Open(argv[optind]) != 0) {
+                    printf("cannot map %s\n", argv[optind]);
+                    return EXIT_FAILURE;
+                }
+                Data = Input.getData();
+                Size = Input.getSize();
+                printf("BENCH: Input=%s Bytes=%zu Repetitions=%d\n", argv[optind], Size, NumRepetitions);
+            } else {
+                xTS_Generator Generator(Config);
+                Generator.Generate(Generated);
+                Data = Generated.data();
+                Size = Generated.size();
+                printf("BENCH: Generated Packets=%lu Seed=%lu Streams=%d Errors=%lu Bytes=%zu Repetitions=%d\n", Config.NumPackets,
+                       Config.Seed, Config.NumStreams, Generator.getNumErrors(), Size, NumRepetitions);
+            }
+
+            xTS_Benchmark Benchmark(Data, Size, NumRepetitions);
+            Benchmark.Run();
+            return 0;
+        }
+
+    protected:
+        template <typename tStage>
+        void xMeasure(const string &Name, uint64_t NumPackets, tStage Stage) {
+            double Best = 1e300;
+            for (uint32_t Repetition = 0; Repetition < m_NumRepetitions; Repetition++) {
+                timespec Begin, End;
+                clock_gettime(CLOCK_MONOTONIC, &Begin);
+                m_Sink += Stage();
+                clock_gettime(CLOCK_MONOTONIC, &End);
+                double Seconds = (End.tv_sec - Begin.tv_sec) + (End.tv_nsec - Begin.tv_nsec) * 1e-9;
+                if (Seconds < Best) Best = Seconds;
+            }
+            printf("BENCH: Stage=%-12s Packets=%lu Best[ms]=%.3f Mpps=%.2f MBps=%.1f\n", Name.c_str(), NumPackets, Best * 1e3,
+                   NumPackets / Best * 1e-6, m_Size / Best * 1e-6);
+        }
+
+        //the sequential extraction loop of main() without logging, the PES streams the PMTs announce (the generated
+        //ones or those of the capture) written to /dev/null, returns the number of PES
+        uint64_t xExtract() {
+            xTS_Demux *Demux = new xTS_Demux;
+            xTS_ContinuityMonitor *Monitor = new xTS_ContinuityMonitor;
+            xTS_ServiceDiscovery *Discovery = new xNullDiscovery(Demux, Monitor);
+            xTS_PacketTable *Table = new xTS_PacketTable;
+            xTS_SyncScanner Scanner;
+            xTS_PacketHeader PacketHeader;
+            xTS_AdaptationField AdaptationField;
+            Discovery->Init(false);
+
+            size_t Offset = 0;
+            while (Offset + xTS::TS_PacketLength <= m_Size) {
+                size_t NumSkippedBytes;
+                uint32_t NumPackets = Scanner.Scan(m_Data + Offset, m_Size - Offset, NumSkippedBytes, true);
+                if (NumPackets == 0) {
+                    if (NumSkippedBytes == 0 and !Scanner.isLocked()) break;
+                    Offset += NumSkippedBytes;
+                    continue;
+                }
+                if (NumPackets > xTS_PacketTable::MaxNumPackets) NumPackets = xTS_PacketTable::MaxNumPackets;
+                uint32_t Stride = Scanner.getPacketSize();
+                Table->Parse(m_Data + Offset, NumPackets, Stride);
+                for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++) {
+                    const uint8_t *Packet = m_Data + Offset + (size_t) PacketIdx * Stride;
+                    xTS_ContinuityMonitor::eResult Continuity = Monitor->Check(Packet, Table->getPacketIdentifier(PacketIdx),
+                            Table->getContinuityCounter(PacketIdx), Table->getAdaptationFieldControl(PacketIdx),
+                            Table->isTransportErrorIndicator(PacketIdx), Table->getTransportScramblingControl(PacketIdx));
+                    xTS_PacketHandler *Handler = Demux->getHandler(Table->getPacketIdentifier(PacketIdx));
+                    if (Handler == nullptr or Continuity == xTS_ContinuityMonitor::eResult::Duplicate) continue;
+                    PacketHeader.Parse(Packet);
+                    AdaptationField.Reset();
+                    if (PacketHeader.hasAdaptationField()) AdaptationField.Parse(Packet, PacketHeader.getAdaptationFieldControl());
+                    if (xTS_ContinuityMonitor::isLoss(Continuity)) Handler->SignalLoss();
+                    Handler->Handle(Packet, &PacketHeader, &AdaptationField);
+                }
+                Offset += (size_t) NumPackets * Stride;
+            }
+            Demux->Flush();
+            uint64_t Sum = 0;
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                const xPES_Assembler *Assembler = dynamic_cast<const xPES_Assembler *>(Demux->getHandler(PID));
+                if (Assembler != nullptr) Sum += Assembler->getNumPES();
+            }
+            delete Discovery;
+            delete Demux;
+            delete Monitor;
+            delete Table;
+            return Sum;
+        }
+};
+
+//task indices spread over per worker deques: a worker takes its newest task, an idle one steals the oldest task of
+//another worker, so large inputs queued first do not keep a single thread busy at the end
+class xWorkStealingPool {
+    protected:
+        struct xQueue {
+            mutex Mutex;
+            deque<uint32_t> Tasks;
+        };
+
+        vector<xQueue> m_Queues;
+        atomic<uint64_t> m_NumSteals{0};
+
+    public:
+        explicit xWorkStealingPool(uint32_t NumWorkers) : m_Queues(NumWorkers) {}
+
+        void Push(uint32_t WorkerIdx, uint32_t Task) {
+            lock_guard<mutex> Lock(m_Queues[WorkerIdx].Mutex);
+            m_Queues[WorkerIdx].Tasks.push_back(Task);
+        }
+
+        //false when no worker has tasks left, tasks are not added while running
+        bool Pop(uint32_t WorkerIdx, uint32_t &Task) {
+            {
+                xQueue &Own = m_Queues[WorkerIdx];
+                lock_guard<mutex> Lock(Own.Mutex);
+                if (!Own.Tasks.empty()) {
+                    Task = Own.Tasks.back();
+                    Own.Tasks.pop_back();
+                    return true;
+                }
+            }
+            for (uint32_t Offset = 1; Offset < m_Queues.size(); Offset++) {
+                xQueue &Victim = m_Queues[(WorkerIdx + Offset) % m_Queues.size()];
+                lock_guard<mutex> Lock(Victim.Mutex);
+                if (Victim.Tasks.empty()) continue;
+                Task = Victim.Tasks.front();
+                Victim.Tasks.pop_front();
+                m_NumSteals.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        //Work(WorkerIdx, Task) on one thread per worker until all tasks are done
+        template <typename tWork>
+        void Run(tWork Work) {
+            vector<thread> Workers;
+            for (uint32_t WorkerIdx = 0; WorkerIdx < m_Queues.size(); WorkerIdx++) {
+                Workers.emplace_back([this, WorkerIdx, &Work]() {
+                    uint32_t Task;
+                    while (Pop(WorkerIdx, Task)) Work(WorkerIdx, Task);
+                });
+            }
+            for (thread &Worker : Workers) Worker.join();
+        }
+
+        uint64_t getNumSteals() const { return m_NumSteals.load(memory_order_relaxed); }
+};
+
+//service discovery of a batch thread: assemblers of a finished file are kept per PID and reopened for the next one,
+//short segments of one encoder reuse the same assemblers and PES buffers throughout the batch
+class xTS_RecyclingDiscovery : public xTS_ServiceDiscovery {
+    protected:
+        xPES_Assembler *m_Spares[xTS_Demux::NumPIDs] = {};
+        uint8_t m_SpareTypes[xTS_Demux::NumPIDs] = {};
+        string m_OutputPrefix;
+        uint32_t m_NumReused = 0;
+        uint32_t m_NumCreated = 0;
+
+    public:
+        xTS_RecyclingDiscovery(xTS_Demux *Demux, xTS_ContinuityMonitor *Monitor) : xTS_ServiceDiscovery(Demux, Monitor) {}
+
+        ~xTS_RecyclingDiscovery() override {
+            for (xPES_Assembler *Assembler : m_Spares) delete Assembler;
+        }
+
+        //outputs of the next file are named <OutputPrefix>.pid<PID>.<extension>
+        void setOutputPrefix(const string &OutputPrefix) { m_OutputPrefix = OutputPrefix; }
+
+        //registers a spare assembler of the same stream type or a new one, returns 0 on success
+        int32_t Attach(uint16_t PID, uint8_t StreamType, const char *Extension) {
+            string OutputPath = m_OutputPrefix + ".pid" + to_string(PID) + "." + Extension;
+            xPES_Assembler *Assembler = m_Spares[PID];
+            m_Spares[PID] = nullptr;
+            if (Assembler != nullptr and m_SpareTypes[PID] == StreamType) {
+                if (Assembler->Reopen(OutputPath.c_str()) != 0) {
+                    m_Spares[PID] = Assembler;
+                    return -1;
+                }
+                m_NumReused++;
+            } else {
+                delete Assembler;
+                Assembler = xPES_AssemblerFactory::Create(PID, OutputPath.c_str(), StreamType, false, m_DropCorrupt, false);
+                if (Assembler == nullptr) return -1;
+                m_NumCreated++;
+            }
+            m_SpareTypes[PID] = StreamType;
+            if (m_Demux->Register(PID, Assembler) != 0) {
+                m_Spares[PID] = Assembler;
+                return -1;
+            }
+            return 0;
+        }
+
+        //takes the assemblers of the finished file back as spares, forgets the tables and starts over with the PAT
+        void Recycle() {
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                xPES_Assembler *Assembler = dynamic_cast<xPES_Assembler *>(m_Demux->getHandler(PID));
+                if (Assembler == nullptr) continue;
+                m_Demux->Detach(PID);
+                m_Spares[PID] = Assembler;
+            }
+            m_Demux->Reset();
+            Reset();
+            xRegisterSectionAssembler(PATPID);
+        }
+
+        uint32_t getNumReused() const { return m_NumReused; }
+        uint32_t getNumCreated() const { return m_NumCreated; }
+
+    protected:
+        void xRegisterAssembler(uint16_t PID, uint8_t StreamType) override {
+            const char *Extension = getStreamExtension(StreamType);
+            if (!m_AutoExtract or Extension == nullptr or m_Demux->getHandler(PID) != nullptr) return;
+            if (Attach(PID, StreamType, Extension) != 0) printf("cannot extract PID %d to %s.pid%d.%s\n", PID, m_OutputPrefix.c_str(), PID, Extension);
+        }
+};
+
+//one line of the batch summary
+struct xTS_BatchResult {
+    int32_t Status = -1;                //0 - parsed, -1 - cannot open, -2 - cannot write outputs, -3 - no packets
+    uint32_t WorkerIdx = 0;
+    uint64_t NumBytes = 0;
+    uint64_t NumPackets = 0;
+    uint64_t NumContinuityErrors = 0;
+    uint64_t NumTransportErrors = 0;
+    uint32_t NumSyncLosses = 0;
+    uint32_t NumSyncByteErrors = 0;
+    uint32_t NumPrograms = 0;
+    uint32_t NumStreams = 0;
+    uint32_t NumPES = 0;
+    uint32_t NumCorruptPES = 0;
+    double Time = 0;                    //s
+};
+
+//parser state of one batch thread, kept across files: demux, monitor, packet table, discovery and assemblers are
+//reset between files instead of being allocated per file
+class xTS_BatchWorker {
+    protected:
+        xTS_Demux m_Demux;
+        xTS_ContinuityMonitor m_Monitor;
+        xTS_ContinuityMonitor m_Total;          //all files of this worker
+        xTS_RecyclingDiscovery m_Discovery{&m_Demux, &m_Monitor};
+        xTS_PacketTable *m_Table = new xTS_PacketTable;
+        xTS_SyncScanner m_Scanner;
+        xTS_PacketHeader m_PacketHeader;
+        xTS_AdaptationField m_AdaptationField;
+        vector<uint16_t> m_PIDs;                //extracted from every file
+        bool m_Extract = false;
+        uint32_t m_NumSyncLosses = 0;
+        uint32_t m_NumSyncByteErrors = 0;
+
+    public:
+        ~xTS_BatchWorker() { delete m_Table; }
+
+        //without Extract files are only analysed, otherwise PIDs and (AutoExtract) streams of the PMT are extracted
+        void Init(const vector<uint16_t> &PIDs, bool AutoExtract, bool DropCorrupt, bool Extract) {
+            m_PIDs = PIDs;
+            m_Extract = Extract;
+            m_Discovery.Init(AutoExtract and Extract, false, DropCorrupt, false);
+        }
+
+        void Process(const char *Path, const string &OutputPrefix, xTS_BatchResult &Result) {
+            timespec Begin, End;
+            clock_gettime(CLOCK_MONOTONIC, &Begin);
+            xTS_MmapInput Input;
+            if (Input.Open(Path) != 0) return;
+
+            m_Monitor.Reset();
+            m_Scanner.Reset();
+            m_Discovery.setOutputPrefix(OutputPrefix);
+            Result.Status = 0;
+            for (uint16_t PID : m_PIDs) {
+                if (m_Extract and m_Discovery.Attach(PID, 0, "es") != 0) Result.Status = -2;
+            }
+
+            const uint8_t *Data = Input.getData();
+            size_t Size = Input.getSize();
+            size_t Position = 0;
+            while (Position < Size) {
+                size_t NumSkippedBytes;
+                uint32_t NumPackets = m_Scanner.Scan(Data + Position, Size - Position, NumSkippedBytes, true);
+                if (NumPackets == 0) {
+                    if (NumSkippedBytes == 0 and !m_Scanner.isLocked()) break;
+                    Position += NumSkippedBytes;
+                    continue;
+                }
+                if (NumPackets > xTS_PacketTable::MaxNumPackets) NumPackets = xTS_PacketTable::MaxNumPackets;
+                uint32_t Stride = m_Scanner.getPacketSize();
+                m_Table->Parse(Data + Position, NumPackets, Stride);
+                for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++) {
+                    const uint8_t *Packet = Data + Position + (size_t) PacketIdx * Stride;
+                    uint16_t PID = m_Table->getPacketIdentifier(PacketIdx);
+                    xTS_ContinuityMonitor::eResult Continuity = m_Monitor.Check(Packet, PID, m_Table->getContinuityCounter(PacketIdx),
+                            m_Table->getAdaptationFieldControl(PacketIdx), m_Table->isTransportErrorIndicator(PacketIdx),
+                            m_Table->getTransportScramblingControl(PacketIdx));
+                    xTS_PacketHandler *Handler = m_Demux.getHandler(PID);
+                    if (Handler == nullptr or Continuity == xTS_ContinuityMonitor::eResult::Duplicate) continue;
+                    m_PacketHeader.Parse(Packet);
+                    m_AdaptationField.Reset();
+                    if (m_PacketHeader.hasAdaptationField()) m_AdaptationField.Parse(Packet, m_PacketHeader.getAdaptationFieldControl());
+                    if (xTS_ContinuityMonitor::isLoss(Continuity)) Handler->SignalLoss();
+                    Handler->Handle(Packet, &m_PacketHeader, &m_AdaptationField);
+                }
+                Position += (size_t) NumPackets * Stride;
+            }
+            m_Demux.Flush();
+
+            Result.NumBytes = Size;
+            Result.NumSyncLosses = m_Scanner.getNumSyncLosses();
+            Result.NumSyncByteErrors = m_Scanner.getNumSyncByteErrors();
+            m_Monitor.getTotals(Result.NumPackets, Result.NumContinuityErrors, Result.NumTransportErrors);
+            if (Result.NumPackets == 0) Result.Status = -3;
+            Result.NumPrograms = m_Discovery.getPrograms().size();
+            for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) {
+                if (m_Discovery.getStreamType(PID) != 0) Result.NumStreams++;
+                xPES_Assembler *Assembler = dynamic_cast<xPES_Assembler *>(m_Demux.getHandler(PID));
+                if (Assembler == nullptr) continue;
+                Result.NumPES += Assembler->getNumPES();
+                Result.NumCorruptPES += Assembler->getNumCorruptPES();
+            }
+            m_Total.Merge(m_Monitor);
+            m_NumSyncLosses += Result.NumSyncLosses;
+            m_NumSyncByteErrors += Result.NumSyncByteErrors;
+            m_Discovery.Recycle();
+
+            clock_gettime(CLOCK_MONOTONIC, &End);
+            Result.Time = (End.tv_sec - Begin.tv_sec) + (End.tv_nsec - Begin.tv_nsec) * 1e-9;
+        }
+
+        const xTS_ContinuityMonitor &getTotal() const { return m_Total; }
+        uint32_t getNumSyncLosses() const { return m_NumSyncLosses; }
+        uint32_t getNumSyncByteErrors() const { return m_NumSyncByteErrors; }
+        uint32_t getNumReused() const { return m_Discovery.getNumReused(); }
+        uint32_t getNumCreated() const { return m_Discovery.getNumCreated(); }
+};
+
+//many short captures (HLS segments) in one process: files from a list or directory are scheduled largest first on a
+//work stealing pool, each thread reuses its parser state, results go to one summary in input order
+class xTS_Batch {
+    public:
+        static constexpr const char *Usage = "usage: batch [-t threads] [-o output_dir [-a] [-p PID]... [-D]] [-r summary.csv] <list.txt | directory>\n";
+
+        static int Main(int argc, char *argv[]) {
+            uint32_t NumWorkers = thread::hardware_concurrency() != 0 ? thread::hardware_concurrency() : 1;
+            const char *OutputDirectory = nullptr;
+            const char *SummaryPath = nullptr;
+            bool AutoExtract = false;
+            bool DropCorrupt = false;
+            vector<uint16_t> PIDs;
+            int Option;
+            while ((Option = getopt(argc, argv, "t:o:ap:Dr:")) != -1) {
+                switch (Option) {
+                    case 't': NumWorkers = atoi(optarg); break;
+                    case 'o': OutputDirectory = optarg; break;
+                    case 'a': AutoExtract = true; break;
+                    case 'D': DropCorrupt = true; break;
+                    case 'r': SummaryPath = optarg; break;
+                    case 'p': {
+                        char *End;
+                        long PID = strtol(optarg, &End, 0);
+                        if (*End != '\0' or PID < 0 or PID >= xTS_Demux::NumPIDs) {
+                            printf("wrong PID: %s\n", optarg);
+                            return EXIT_FAILURE;
+                        }
+                        PIDs.push_back(PID);
+                        break;
+                    }
+                    default:
+                        printf("%s", Usage);
+                        return EXIT_FAILURE;
+                }
+            }
+            if (optind >= argc or NumWorkers == 0) {
+                printf("%s", Usage);
+                return EXIT_FAILURE;
+            }
+
+            vector<string> Paths;
+            if (xListInputs(argv[optind], Paths) != 0 or Paths.empty()) {
+                printf("no inputs in %s\n", argv[optind]);
+                return EXIT_FAILURE;
+            }
+            if (OutputDirectory != nullptr and mkdir(OutputDirectory, 0777) != 0 and errno != EEXIST) {
+                printf("cannot create %s\n", OutputDirectory);
+                return EXIT_FAILURE;
+            }
+            FILE *Summary = SummaryPath != nullptr ? fopen(SummaryPath, "w") : stdout;
+            if (Summary == nullptr) {
+                printf("cannot write %s\n", SummaryPath);
+                return EXIT_FAILURE;
+            }
+            if (NumWorkers > Paths.size()) NumWorkers = Paths.size();
+
+            //largest first, dealt round robin
+            vector<uint64_t> Sizes(Paths.size(), 0);
+            vector<uint32_t> Order(Paths.size());
+            for (uint32_t FileIdx = 0; FileIdx < Paths.size(); FileIdx++) {
+                struct stat Stat;
+                if (stat(Paths[FileIdx].c_str(), &Stat) == 0) Sizes[FileIdx] = Stat.st_size;
+                Order[FileIdx] = FileIdx;
+            }
+            stable_sort(Order.begin(), Order.end(), [&Sizes](uint32_t A, uint32_t B) { return Sizes[A] > Sizes[B]; });
+            xWorkStealingPool Pool(NumWorkers);
+            //owners take the back of their deque, push smallest first so each starts with its largest file
+            for (uint32_t OrderIdx = Order.size(); OrderIdx-- > 0; ) Pool.Push(OrderIdx % NumWorkers, Order[OrderIdx]);
+
+            vector<xTS_BatchWorker *> Workers;
+            for (uint32_t WorkerIdx = 0; WorkerIdx < NumWorkers; WorkerIdx++) {
+                Workers.push_back(new xTS_BatchWorker);
+                Workers.back()->Init(PIDs, AutoExtract, DropCorrupt, OutputDirectory != nullptr);
+            }
+
+            vector<xTS_BatchResult> Results(Paths.size());
+            timespec Begin, End;
+            clock_gettime(CLOCK_MONOTONIC, &Begin);
+            Pool.Run([&](uint32_t WorkerIdx, uint32_t FileIdx) {
+                string OutputPrefix;
+                if (OutputDirectory != nullptr) OutputPrefix = string(OutputDirectory) + "/" + xStem(Paths[FileIdx]);
+                Results[FileIdx].WorkerIdx = WorkerIdx;
+                Workers[WorkerIdx]->Process(Paths[FileIdx].c_str(), OutputPrefix, Results[FileIdx]);
+            });
+            clock_gettime(CLOCK_MONOTONIC, &End);
+            double Time = (End.tv_sec - Begin.tv_sec) + (End.tv_nsec - Begin.tv_nsec) * 1e-9;
+
+            fprintf(Summary, "file,status,bytes,packets,sync_losses,sync_byte_errors,cc_errors,tei,programs,streams,pes,corrupt_pes,ms,worker\n");
+            xTS_ContinuityMonitor *Total = new xTS_ContinuityMonitor;
+            uint64_t NumBytes = 0, NumPackets = 0;
+            uint32_t NumFailed = 0, NumSyncLosses = 0, NumSyncByteErrors = 0, NumReused = 0, NumCreated = 0;
+            for (uint32_t FileIdx = 0; FileIdx < Paths.size(); FileIdx++) {
+                const xTS_BatchResult &Result = Results[FileIdx];
+                fprintf(Summary, "%s,%d,%lu,%lu,%d,%d,%lu,%lu,%d,%d,%d,%d,%.3f,%d\n", Paths[FileIdx].c_str(), Result.Status, Result.NumBytes,
+                        Result.NumPackets, Result.NumSyncLosses, Result.NumSyncByteErrors, Result.NumContinuityErrors, Result.NumTransportErrors, Result.NumPrograms,
+                        Result.NumStreams, Result.NumPES, Result.NumCorruptPES, Result.Time * 1e3, Result.WorkerIdx);
+                NumBytes += Result.NumBytes;
+                NumPackets += Result.NumPackets;
+                if (Result.Status != 0) NumFailed++;
+            }
+            if (Summary != stdout) fclose(Summary);
+            for (xTS_BatchWorker *Worker : Workers) {
+                Total->Merge(Worker->getTotal());
+                NumSyncLosses += Worker->getNumSyncLosses();
+                NumSyncByteErrors += Worker->getNumSyncByteErrors();
+                NumReused += Worker->getNumReused();
+                NumCreated += Worker->getNumCreated();
+                delete Worker;
+            }
+
+            printf("BATCH: Files=%zu Failed=%d Workers=%d Bytes=%lu Packets=%lu Time[s]=%.3f Files/s=%.1f MBps=%.1f Steals=%lu "
+                   "AssemblersReused=%d AssemblersCreated=%d\n", Paths.size(), NumFailed, NumWorkers, NumBytes, NumPackets, Time,
+                   Paths.size() / Time, NumBytes / Time * 1e-6, Pool.getNumSteals(), NumReused, NumCreated);
+            Total->PrintReport(NumSyncLosses, NumSyncByteErrors);
+            delete Total;
+            return NumFailed == 0 ? 0 : EXIT_FAILURE;
+        }
+
+    protected:
+        //a directory yields its *.ts, *.m2ts and *.mts files sorted by name, anything else is read as a list of paths
+        static int32_t xListInputs(const char *Path, vector<string> &Paths) {
+            struct stat Stat;
+            if (stat(Path, &Stat) != 0) return -1;
+            if (S_ISDIR(Stat.st_mode)) {
+                DIR *Directory = opendir(Path);
+                if (Directory == nullptr) return -1;
+                while (dirent *Entry = readdir(Directory)) {
+                    string Name = Entry->d_name;
+                    size_t Dot = Name.rfind('.');
+                    string Extension = Dot != string::npos ? Name.substr(Dot) : "";
+                    if (Extension == ".ts" or Extension == ".m2ts" or Extension == ".mts") Paths.push_back(string(Path) + "/" + Name);
+                }
+                closedir(Directory);
+                sort(Paths.begin(), Paths.end());
+                return 0;
+            }
+            FILE *List = fopen(Path, "r");
+            if (List == nullptr) return -1;
+            char Line[4096];
+            while (fgets(Line, sizeof(Line), List) != nullptr) {
+                size_t Length = strcspn(Line, "\r\n");
+                Line[Length] = '\0';
+                if (Length != 0 and Line[0] != '#') Paths.push_back(Line);
+            }
+            fclose(List);
+            return 0;
+        }
+
+        //file name without directory and extension
+        static string xStem(const string &Path) {
+            size_t Slash = Path.rfind('/');
+            string Name = Slash != string::npos ? Path.substr(Slash + 1) : Path;
+            size_t Dot = Name.rfind('.');
+            return Dot != string::npos and Dot != 0 ? Name.substr(0, Dot) : Name;
+        }
+};
+
+int main( int argc, char *argv[ ], char *envp[ ]) {
+    xTS_Demux TS_Demux;
+    vector<const char *> PIDArguments;
+    bool ZeroCopy = false;
+    uint32_t NumWorkers = 0;
+    uint32_t NumChunks = 0;
+    xTS_Logger::eMode LogMode = xTS_Logger::eMode::Text;
+    bool DropCorrupt = false;
+    bool AutoExtract = false;
+    bool ClockAnalysis = false;
+    bool SplitAccessUnits = false;
+    const char *IndexPath = nullptr;
+    const char *SeekIndexPath = nullptr;
+    double SeekBegin = 0;
+    double SeekEnd = -1;
+    string InstrumentPath;
+    uint32_t InstrumentInterval = 1000;
+    bool Streaming = false;
+    uint32_t IdleTimeout = 100;             //ms
+    uint32_t MaxBufferedBytes = 1 << 20;    //per PID
+    vector<string> DiscoveredArguments;
+    vector<uint8_t> StreamTypes(xTS_Demux::NumPIDs, 0);    //from the PMT, 0 - unknown
+
+    //tool modes sharing the parser
+    if (argc > 1 and strcmp(argv[1], "generate") == 0) return xTS_Generator::Main(argc - 1, argv + 1);
+    if (argc > 1 and strcmp(argv[1], "bench") == 0) return xTS_Benchmark::Main(argc - 1, argv + 1);
+    if (argc > 1 and strcmp(argv[1], "batch") == 0) return xTS_Batch::Main(argc - 1, argv + 1);
+
+    const char *Usage = "usage: %s [-a] [-c] [-u] [-x index | -X index -S begin[:end]] [-z] [-D] [-t workers | -j chunks] [-l off|text|bin|ndjson|csv] [-I stats.prom|stats.json[:ms]] [-s] [-w idle_ms] [-m bytes] [-p PID[:output|-]]... <input.ts | - | udp://[group]:port | rtp://[group]:port>\n"
+                        "       %s generate|bench|batch ...\n";
+    int Option;
+
+    while ((Option = getopt(argc, argv, "p:zt:j:l:Dacux:X:S:I:sw:m:")) != -1) {
+        switch (Option) {
+            case 'p':
+                PIDArguments.push_back(optarg);
+                break;
+            case 'z':
+                ZeroCopy = true;
+                break;
+            case 't':
+                NumWorkers = atoi(optarg);
+                break;
+            case 'j':
+                NumChunks = atoi(optarg);
+                break;
+            case 'D':
+                DropCorrupt = true;
+                break;
+            case 'a':
+                AutoExtract = true;
+                break;
+            case 'c':
+                ClockAnalysis = true;
+                break;
+            case 'u':
+                SplitAccessUnits = true;
+                break;
+            case 'x':
+                IndexPath = optarg;
+                break;
+            case 'X':
+                SeekIndexPath = optarg;
+                break;
+            case 'S': {
+                //seconds from the first PTS of the indexed video
+                char *End;
+                SeekBegin = strtod(optarg, &End);
+                if (*End == ':') SeekEnd = strtod(End + 1, &End);
+                if (*End != '\0' or SeekBegin < 0 or (SeekEnd >= 0 and SeekEnd < SeekBegin)) {
+                    printf("wrong seek range: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'I': {
+                //optional export interval after the last colon, 0 writes once at the end
+                InstrumentPath = optarg;
+                size_t Colon = InstrumentPath.rfind(':');
+                if (Colon != string::npos and Colon + 1 < InstrumentPath.size() and
+                    strspn(InstrumentPath.c_str() + Colon + 1, "0123456789") == InstrumentPath.size() - Colon - 1) {
+                    InstrumentInterval = atoi(InstrumentPath.c_str() + Colon + 1);
+                    InstrumentPath.resize(Colon);
+                }
+                if (!xTS_Instrument::Enabled) {
+                    printf("instrumentation is not compiled in, build with -DTS_PARSER_INSTRUMENT\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 's':
+                Streaming = true;
+                break;
+            case 'w':
+                Streaming = true;
+                IdleTimeout = atoi(optarg);
+                break;
+            case 'm':
+                Streaming = true;
+                MaxBufferedBytes = strtoul(optarg, nullptr, 0);
+                if (MaxBufferedBytes < xTS::TS_PacketLength) {
+                    printf("wrong buffer cap: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if (xTS_Logger::ParseMode(optarg, LogMode) != 0) {
+                    printf("wrong log mode: %s (off, text, bin, ndjson, csv)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printf(Usage, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        printf(Usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    xTS_Input *Input = xTS_Input::Create(argv[optind]);
+
+    if (Input == nullptr) {
+        printf("wrong file name\n");
+        return EXIT_FAILURE;
+    }
+
+    //Ctrl+C ends a live capture with outputs and statistics written instead of killing the process
+    static volatile sig_atomic_t Stop = 0;
+    if (Input->SetStopFlag(&Stop)) {
+        struct sigaction Action = {};
+        Action.sa_handler = [](int) { Stop = 1; };
+        sigemptyset(&Action.sa_mask);
+        sigaction(SIGINT, &Action, nullptr);
+        sigaction(SIGTERM, &Action, nullptr);
+    }
+
+    if (ClockAnalysis and (NumChunks > 0 or NumWorkers > 0)) {
+        printf("clock analysis needs packets in arrival order, run without -t/-j\n");
+        return EXIT_FAILURE;
+    }
+    if (Streaming and (NumChunks > 0 or NumWorkers > 0)) {
+        printf("streaming runs without -t/-j\n");
+        return EXIT_FAILURE;
+    }
+    if ((IndexPath != nullptr or SplitAccessUnits) and (NumChunks > 0 or NumWorkers > 0)) {
+        printf("indexing and access unit splitting run without -t/-j\n");
+        return EXIT_FAILURE;
+    }
+
+    //jump to the random access points around the requested range instead of scanning the whole capture
+    if (SeekIndexPath != nullptr) {
+        xTS_MmapInput *MmapInput = dynamic_cast<xTS_MmapInput *>(Input);
+        xTS_Index Index;
+        if (MmapInput == nullptr or NumChunks > 0) {
+            printf("seeking needs a mappable input file and runs without -j\n");
+            return EXIT_FAILURE;
+        }
+        const xTS_IndexStream *Stream = nullptr;
+        if (Index.Open(SeekIndexPath, MmapInput->getSize()) != 0 or (Stream = Index.FindStream()) == nullptr) {
+            printf("index %s does not match %s or has no random access points\n", SeekIndexPath, argv[optind]);
+            return EXIT_FAILURE;
+        }
+        uint64_t Begin, End, Unused;
+        Index.Seek(Stream, (uint64_t) (SeekBegin * 90000), Begin, Unused);
+        End = MmapInput->getSize();
+        if (SeekEnd >= 0) Index.Seek(Stream, (uint64_t) (SeekEnd * 90000), Unused, End);
+        MmapInput->Restrict(Begin, End);
+        printf("SEEK: PID=%d Begin=%lu End=%lu\n", Stream->PID, Begin, End);
+    }
+
+    //threaded modes cannot register PIDs on the fly, PSI is read from the beginning of the mapped file first
+    if (AutoExtract and (NumChunks > 0 or NumWorkers > 0)) {
+        xTS_MmapInput *MmapInput = dynamic_cast<xTS_MmapInput *>(Input);
+        if (MmapInput == nullptr) {
+            printf("automatic extraction with -t/-j needs a mappable input file\n");
+            return EXIT_FAILURE;
+        }
+        xTS_ServiceDiscovery *Discovery = xTS_ServiceDiscovery::Probe(MmapInput->getData(), MmapInput->getSize());
+        Discovery->getStreamArguments(DiscoveredArguments);
+        for (uint32_t PID = 0; PID < xTS_Demux::NumPIDs; PID++) StreamTypes[PID] = Discovery->getStreamType(PID);
+        Discovery->PrintStats();
+        delete Discovery;
+        //explicit -p arguments win over discovered streams
+        vector<bool> Requested(xTS_Demux::NumPIDs, false);
+        for (const char *Argument : PIDArguments) {
+            int32_t PID = -1;
+            char DefaultPath[32];
+            if (xTS_Demux::ParseArgument(Argument, PID, DefaultPath, sizeof(DefaultPath)) != nullptr) Requested[PID] = true;
+        }
+        for (const string &Argument : DiscoveredArguments) {
+            if (!Requested[atoi(Argument.c_str())]) PIDArguments.push_back(Argument.c_str());
+        }
+    }
+
+    if (!InstrumentPath.empty() and xTS_Instrument::Start(InstrumentPath.c_str(), InstrumentInterval) != 0) {
+        printf("cannot write instrumentation to %s\n", InstrumentPath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    //chunks of a mapped file parsed in parallel, no per packet logging
+    if (NumChunks > 0) {
+        xTS_MmapInput *MmapInput = dynamic_cast<xTS_MmapInput *>(Input);
+        if (MmapInput == nullptr) {
+            printf("chunked parsing needs a mappable input file\n");
+            return EXIT_FAILURE;
+        }
+        xTS_ChunkedExtractor *Extractor = new xTS_ChunkedExtractor;
+        if (Extractor->Init(MmapInput, NumChunks, PIDArguments, StreamTypes, DropCorrupt) != 0 or Extractor->Run() != 0) return EXIT_FAILURE;
+        xTS_Instrument::Stop();
+        Extractor->PrintStats();
+        delete Extractor;
+        delete Input;
+        return 0;
+    }
+
+    //pipelined run, no per packet logging
+    if (NumWorkers > 0) {
+        xTS_Pipeline *Pipeline = new xTS_Pipeline;
+        if (Pipeline->Init(Input, NumWorkers, PIDArguments, StreamTypes, ZeroCopy, DropCorrupt) != 0) return EXIT_FAILURE;
+        Pipeline->Run();
+        xTS_Instrument::Stop();
+        Pipeline->PrintStats();
+        Input->PrintStats();
+        delete Pipeline;
+        delete Input;
+        return 0;
+    }
+
+    if (ZeroCopy and !Input->isPersistent()) {
+        printf("zero copy output needs a mappable input file, copying payloads\n");
+        ZeroCopy = false;
+    }
+
+    //completed PES leave as soon as possible and memory per PID stays bounded, the idle flush needs a pipe or stdin
+    if (Streaming) {
+        TS_Demux.SetStreaming(MaxBufferedBytes);
+        if (IdleTimeout != 0) Input->SetIdleConsumer(&TS_Demux, IdleTimeout);
+    }
+
+    for (const char *Argument : PIDArguments) {
+        if (TS_Demux.RegisterFromArgument(Argument, ZeroCopy, DropCorrupt, LogMode != xTS_Logger::eMode::Off or SplitAccessUnits) < 0) {
+            printf("wrong PID or output file: %s\n", Argument);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const uint8_t *InputBlock;
+    size_t NumInputBytes;
+    xTS_SyncScanner TS_SyncScanner;
+    xTS_PacketTable TS_PacketTable;
+    xTS_PacketHeader TS_PacketHeader;
+    xTS_AdaptationField TS_PacketAdaptationField;
+
+    uint64_t TS_PacketId = 0;
+    xTS_ContinuityMonitor *TS_Monitor = new xTS_ContinuityMonitor;
+    xTS_ServiceDiscovery *TS_Discovery = new xTS_ServiceDiscovery(&TS_Demux, TS_Monitor);
+    TS_Discovery->Init(AutoExtract, ZeroCopy, DropCorrupt, LogMode != xTS_Logger::eMode::Off or SplitAccessUnits, SplitAccessUnits);
+    xTS_ClockAnalyzer *TS_ClockAnalyzer = ClockAnalysis ? new xTS_ClockAnalyzer : nullptr;
+    xTS_IndexWriter *TS_IndexWriter = IndexPath != nullptr ? new xTS_IndexWriter : nullptr;
+    xTS_Logger TS_Logger;
+    TS_Logger.Init(LogMode);
+
+    uint64_t Ticks = xTS_Instrument::Begin();
+    bool Final = false;     //input cannot fill a confirmation window any more, the tail is scanned as it is
+    while ((InputBlock = Input->Acquire(NumInputBytes, Final ? xTS::TS_PacketLength : TS_SyncScanner.getMinBytes())) != nullptr or !Final) {
+        if (InputBlock == nullptr) {
+            Final = true;
+            continue;
+        }
+        Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Read, Ticks);
+        size_t NumSkippedBytes;
+        uint32_t NumPackets = TS_SyncScanner.Scan(InputBlock, NumInputBytes, NumSkippedBytes, Final);
+        Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Sync, Ticks);
+        if (NumPackets == 0) {
+            Input->Release(NumSkippedBytes);
+            continue;
+        }
+        if (NumPackets > xTS_PacketTable::MaxNumPackets) NumPackets = xTS_PacketTable::MaxNumPackets;
+        uint32_t PacketStride = TS_SyncScanner.getPacketSize();
+        TS_PacketTable.Parse(InputBlock, NumPackets, PacketStride);
+        Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Table, Ticks);
+
+        for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++) {
+            const uint8_t *TS_PacketBuffer = InputBlock + PacketIdx * PacketStride;
+            uint16_t PID = TS_PacketTable.getPacketIdentifier(PacketIdx);
+            xTS_PacketHandler *Handler = TS_Demux.getHandler(PID);
+            int32_t Result = 0;
+
+            //only handlers, the logger and the index need the full header, the monitor reads the table
+            if (Handler != nullptr or LogMode != xTS_Logger::eMode::Off or TS_IndexWriter != nullptr) {
+                TS_PacketHeader.Parse(TS_PacketBuffer);
+                Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Header, Ticks);
+                TS_PacketAdaptationField.Reset();
+                if (TS_PacketHeader.hasAdaptationField()) {
+                    TS_PacketAdaptationField.Parse(TS_PacketBuffer, TS_PacketHeader.getAdaptationFieldControl());
+                    Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Adaptation, Ticks);
+                }
+            }
+
+            xTS_ContinuityMonitor::eResult Continuity = TS_Monitor->Check(TS_PacketBuffer, TS_PacketTable, PacketIdx);
+            Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Monitor, Ticks);
+            xTS_Instrument::CountPacket(PID, PacketStride);
+            if (TS_ClockAnalyzer != nullptr and Continuity != xTS_ContinuityMonitor::eResult::Duplicate and
+                xTS_ClockAnalyzer::hasPCR(TS_PacketBuffer)) {
+                int64_t ArrivalTime = Input->getArrivalTime(Input->getNumConsumedBytes() + (uint64_t) PacketIdx * PacketStride);
+                TS_ClockAnalyzer->AbsorbPCR(TS_PacketBuffer, PID, TS_PacketId, ArrivalTime);
+            }
+            if (TS_IndexWriter != nullptr and Continuity != xTS_ContinuityMonitor::eResult::Duplicate) {
+                TS_IndexWriter->AbsorbPacket(TS_PacketBuffer, &TS_PacketHeader, &TS_PacketAdaptationField,
+                                             Input->getNumConsumedBytes() + (uint64_t) PacketIdx * PacketStride);
+            }
+            if (Handler != nullptr and Continuity != xTS_ContinuityMonitor::eResult::Duplicate) {
+                if (xTS_ContinuityMonitor::isLoss(Continuity)) Handler->SignalLoss();
+                Ticks = xTS_Instrument::Begin();
+                Result = Handler->Handle(TS_PacketBuffer, &TS_PacketHeader, &TS_PacketAdaptationField);
+                Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Assembly, Ticks);
+            }
+            TS_Logger.Packet(TS_PacketId, &TS_PacketHeader, &TS_PacketAdaptationField, Handler, Result);
+            Ticks = xTS_Instrument::Lap(xTS_Instrument::eStage::Log, Ticks);
+            TS_PacketId++;
+        }
+        Input->Release(TS_SyncScanner.getNumBytes(NumPackets, NumInputBytes));
     }
-    if(PES_Assembler174.getOfs()){
-        fwrite(PES_Assembler174.getBuffer(), PES_Assembler174.getNumPacketBytes(), 1, PES_Assembler174.getOfs());
-        fclose(PES_Assembler174.getOfs());
+    TS_Logger.Flush();
+    xTS_Instrument::Stop();
+    Input->PrintStats();
+    TS_SyncScanner.Print();
+    TS_Monitor->PrintReport(TS_SyncScanner.getNumSyncLosses(), TS_SyncScanner.getNumSyncByteErrors());
+    if (TS_ClockAnalyzer != nullptr) TS_ClockAnalyzer->PrintReport(TS_Monitor);
+    TS_Discovery->PrintStats();
+    if (TS_IndexWriter != nullptr) {
+        xTS_MmapInput *MmapInput = dynamic_cast<xTS_MmapInput *>(Input);
+        uint64_t InputSize = MmapInput != nullptr ? MmapInput->getSize() : Input->getNumConsumedBytes();
+        if (TS_IndexWriter->Write(IndexPath, TS_SyncScanner.getPacketSize(), InputSize) != 0) printf("cannot write index %s\n", IndexPath);
+        TS_IndexWriter->PrintStats();
     }
-    fclose(file);
+    TS_Demux.Flush();
+    TS_Demux.PrintStats();
+    delete TS_Monitor;
+    delete TS_Discovery;
+    delete TS_ClockAnalyzer;
+    delete TS_IndexWriter;
+    Input->Close();
+    delete Input;
     return 0;
-}
\ No newline at end of file
+}